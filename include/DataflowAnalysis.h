@@ -2,17 +2,31 @@
 #ifndef DATAFLOW_ANALYSIS_H
 #define DATAFLOW_ANALYSIS_H
 
+#include <algorithm>
+#include <atomic>
 #include <deque>
-#include <numeric>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SCCIterator.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/ThreadPool.h"
 
+#include "FixpointTrace.h"
 #include "utils.h"
 
 
@@ -52,6 +66,349 @@ public:
   }
 };
 
+// Hands out memory from a bump allocator to containers that live no longer
+// than it does. Deallocation does nothing; the memory is released all at once
+// when the allocator is destroyed or reset.
+template <typename T>
+class ArenaAllocator {
+public:
+  using value_type = T;
+
+  explicit ArenaAllocator(llvm::BumpPtrAllocator& arena) : arena(&arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+  T*
+  allocate(size_t n) {
+    return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, size_t) {}
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const {
+    return arena == other.arena;
+  }
+
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const {
+    return arena != other.arena;
+  }
+
+  llvm::BumpPtrAllocator* arena;
+};
+
+// Counters describing how much work the fixpoint loop performed. A single
+// instance is shared by an analysis and all of the callee analyses it spawns,
+// so the totals cover everything done on behalf of one top level function.
+struct FixpointStats {
+  std::atomic<unsigned long> analyses{0};    // computeForwardDataflow calls
+  std::atomic<unsigned long> blockVisits{0}; // blocks propagated, once per
+                                             // lane of a batch
+  std::atomic<unsigned long> transfers{0};   // instructions propagated through,
+                                             // except replayed cached effects
+  std::atomic<unsigned long> takesSaved{0};  // worklist takes that batched
+                                             // lanes shared with the first
+};
+
+// Supplies closed form abstract values for the phis of loop headers, so that
+// loops with a known trip count converge without repeated widening. Values
+// are computed once per function and cached, since callee analyses revisit
+// the same functions with different arguments. The cache is node based so
+// that references handed out remain valid while nested analyses add to it.
+template <typename AbstractValue>
+class LoopAcceleration {
+public:
+  using HeaderValues = llvm::DenseMap<llvm::PHINode*, AbstractValue>;
+  using Compute = std::function<HeaderValues(llvm::Function&)>;
+
+  explicit LoopAcceleration(Compute compute) : compute(compute) {}
+
+  const HeaderValues&
+  headerValuesFor(llvm::Function& f) {
+    auto found = cache.find(&f);
+    if (cache.end() == found) {
+      found = cache.insert({&f, compute(f)}).first;
+    }
+    return found->second;
+  }
+
+private:
+  Compute compute;
+  std::unordered_map<llvm::Function*, HeaderValues> cache;
+};
+
+
+// Decides which values the states of a function carry. A value is tracked
+// when its state can reach an effect of the analysis: the arguments of calls,
+// returned values, the operands of comparisons, branch conditions and the
+// operands a transfer reads for effects such as reports, along with every
+// value these are computed from. Tracked values are then only kept in the
+// states of blocks they are live in, i.e. from which one of their uses can be
+// reached, so merges, comparisons and copies of states scale with the values
+// live at a block rather than with every value defined before it.
+//
+// Transfers are assumed to compute the value of an instruction from all of
+// its operands. Phi operands are live into the phi's block rather than just
+// out of the incoming block, since phis read them from the merged state.
+// Values other than instructions and arguments are always kept. As with
+// LoopAcceleration, each function is examined once and the result cached.
+class StateLiveness {
+public:
+  // Whether the transfer of an instruction reads the state of one of its
+  // operands for an effect other than the value of the instruction itself.
+  using ReadsOperand = std::function<bool(llvm::Instruction&, unsigned)>;
+
+  struct Sets {
+    // tracked instructions and arguments, numbered for the bit vectors
+    llvm::DenseMap<llvm::Value*, unsigned> numbers;
+    llvm::DenseMap<llvm::BasicBlock*, llvm::BitVector> liveIn;
+    llvm::DenseMap<llvm::BasicBlock*, llvm::BitVector> liveOut;
+
+    bool
+    isTracked(llvm::Value* v) const {
+      return !(llvm::isa<llvm::Instruction>(v) || llvm::isa<llvm::Argument>(v))
+        || numbers.count(v);
+    }
+
+    // whether an operand's state may be read, or written in its absence
+    bool
+    tracksOperandOf(llvm::Instruction& i) const {
+      return std::any_of(i.op_begin(), i.op_end(),
+        [this] (llvm::Use& op) { return numbers.count(op.get()); });
+    }
+
+    bool
+    isLive(const llvm::BitVector& live, llvm::Value* v) const {
+      if (!llvm::isa<llvm::Instruction>(v) && !llvm::isa<llvm::Argument>(v)) {
+        return true;
+      }
+      auto found = numbers.find(v);
+      return numbers.end() != found && live.test(found->second);
+    }
+  };
+
+  explicit StateLiveness(ReadsOperand readsOperand)
+    : readsOperand(readsOperand) {}
+
+  const Sets&
+  setsFor(llvm::Function& f) {
+    auto found = cache.find(&f);
+    if (cache.end() == found) {
+      found = cache.insert({&f, Sets()}).first;
+      compute(f, found->second);
+    }
+    return found->second;
+  }
+
+  // Forget every function, e.g. before the module they belong to is
+  // destroyed and another may reuse their addresses.
+  void
+  clear() {
+    cache.clear();
+  }
+
+private:
+  ReadsOperand readsOperand;
+  std::unordered_map<llvm::Function*, Sets> cache;
+
+  void
+  compute(llvm::Function& f, Sets& sets) {
+    std::vector<llvm::Value*> work;
+    auto track = [&sets, &work] (llvm::Value* v) {
+      if ((llvm::isa<llvm::Instruction>(v) || llvm::isa<llvm::Argument>(v))
+          && sets.numbers.insert({v, sets.numbers.size()}).second) {
+        work.push_back(v);
+      }
+    };
+
+    for (auto& i : llvm::instructions(f)) {
+      if (auto* call = llvm::dyn_cast<llvm::CallInst>(&i)) {
+        for (unsigned a = 0; a < call->getNumArgOperands(); a++) {
+          track(call->getArgOperand(a));
+        }
+      }
+      else if (auto* ret = llvm::dyn_cast<llvm::ReturnInst>(&i)) {
+        if (ret->getReturnValue()) {
+          track(ret->getReturnValue());
+        }
+      }
+      else if (llvm::isa<llvm::CmpInst>(i)) {
+        track(i.getOperand(0));
+        track(i.getOperand(1));
+      }
+      else if (auto* br = llvm::dyn_cast<llvm::BranchInst>(&i)) {
+        if (br->isConditional()) {
+          track(br->getCondition());
+        }
+      }
+      else if (!llvm::isa<llvm::PHINode>(i)) {
+        for (unsigned k = 0; k < i.getNumOperands(); k++) {
+          if (readsOperand(i, k)) {
+            track(i.getOperand(k));
+          }
+        }
+      }
+    }
+    while (!work.empty()) {
+      llvm::Value* v = work.back();
+      work.pop_back();
+      if (auto* i = llvm::dyn_cast<llvm::Instruction>(v)) {
+        for (auto& op : i->operands()) {
+          track(op.get());
+        }
+      }
+    }
+
+    // upward exposed uses and definitions of each block
+    unsigned count = sets.numbers.size();
+    llvm::DenseMap<llvm::BasicBlock*, llvm::BitVector> uses;
+    llvm::DenseMap<llvm::BasicBlock*, llvm::BitVector> defs;
+    for (auto& bb : f) {
+      llvm::BitVector& used = uses[&bb];
+      llvm::BitVector& defined = defs[&bb];
+      used.resize(count);
+      defined.resize(count);
+      for (auto& i : bb) {
+        bool phi = llvm::isa<llvm::PHINode>(i);
+        if (!phi || sets.numbers.count(&i)) {
+          for (auto& op : i.operands()) {
+            auto found = sets.numbers.find(op.get());
+            if (sets.numbers.end() != found
+                && (phi || !defined.test(found->second))) {
+              used.set(found->second);
+            }
+          }
+        }
+        auto self = sets.numbers.find(&i);
+        if (sets.numbers.end() != self) {
+          defined.set(self->second);
+        }
+      }
+      sets.liveIn[&bb].resize(count);
+      sets.liveOut[&bb].resize(count);
+    }
+
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (auto* bb : llvm::post_order(&f)) {
+        llvm::BitVector& out = sets.liveOut[bb];
+        for (auto* s : llvm::successors(bb)) {
+          out |= sets.liveIn[s];
+        }
+        llvm::BitVector in = out;
+        in.reset(defs[bb]);
+        in |= uses[bb];
+        llvm::BitVector& liveIn = sets.liveIn[bb];
+        if (in != liveIn) {
+          liveIn = std::move(in);
+          changed = true;
+        }
+      }
+    }
+  }
+};
+
+
+// Remembers the effect of each pure instruction the last time it was
+// evaluated: the state of each operand, absent or present with a value, and
+// every value the transfer wrote. Functions are revisited both by the
+// fixpoint loop and by callee analyses in other contexts, and wherever the
+// operands are unchanged the effect is replayed instead of recomputed.
+template <typename AbstractValue>
+class TransferCache {
+public:
+  struct Effect {
+    std::vector<std::pair<bool, AbstractValue>> inputs;
+    std::vector<std::pair<llvm::Value*, AbstractValue>> writes;
+  };
+
+  Effect*
+  lookup(llvm::Instruction* i) {
+    auto found = effects.find(i);
+    return effects.end() == found ? nullptr : &found->second;
+  }
+
+  Effect&
+  record(llvm::Instruction* i) {
+    return effects[i];
+  }
+
+  void
+  clear() {
+    effects.clear();
+  }
+
+private:
+  llvm::DenseMap<llvm::Instruction*, Effect> effects;
+};
+
+
+// Decides which callee summaries stay in memory. Analyses given a store ask
+// it whether a summary exists instead of looking in the summaries directly,
+// and hand it every summary they compute at a call, along with the block
+// visits computing it took. The store may then drop other summaries, which
+// are computed again, or restored, the next time they are called for.
+// Summaries of calls still being analyzed are only handed over once done,
+// so the placeholders that stop recursion are never dropped. See
+// SummaryStore.h for a store bounded in bytes.
+template <typename AbstractValue>
+class SummaryStore {
+public:
+  virtual ~SummaryStore() = default;
+
+  // Whether the summaries hold f for args, restoring it first if it was
+  // moved out. Counted as a hit or miss only when count is set.
+  virtual bool
+  lookup(llvm::Function* f, const std::vector<AbstractValue>& args,
+         bool count) = 0;
+
+  // The summary of f for args was computed in cost block visits.
+  virtual void
+  admit(llvm::Function* f, const std::vector<AbstractValue>& args,
+        unsigned long cost) = 0;
+
+  // Summaries handed over so far no longer hold, e.g. since the context
+  // depth they were computed with changed.
+  virtual void
+  invalidate() {}
+
+  void
+  visited() {
+    visits++;
+  }
+
+  // block visits of every analysis using this store so far
+  unsigned long
+  visitCount() const {
+    return visits;
+  }
+
+private:
+  std::atomic<unsigned long> visits{0};
+};
+
+
+// Answers calls to functions that are declared but not defined in the module
+// being analyzed, e.g. from the summaries of the modules defining them.
+// Analyses given one ask it at each such call they would follow into a
+// defined callee, i.e. within the context depth and with a debug location,
+// and otherwise leave the value of the call out of the state, as without.
+template <typename AbstractValue>
+class ExternalCalls {
+public:
+  virtual ~ExternalCalls() = default;
+
+  // Whether the callee's summary for args is known, in which case it is
+  // stored in result. context is the callee's, ending with the call's line.
+  virtual bool
+  resolve(llvm::CallInst& call, const std::vector<AbstractValue>& args,
+          const std::vector<unsigned>& context, AbstractValue& result) = 0;
+};
+
+
 // The dataflow analysis computes three different granularities of results.
 // An AbstractValue represents information in the abstract domain for a single
 // LLVM Value. An AbstractState is the abstract representation of all values
@@ -110,6 +467,42 @@ template <typename AbstractValue, typename AbstractInfo>
 using Summary = llvm::DenseMap<llvm::Function*,Arg2Ret<AbstractValue, AbstractInfo> >;
 
 
+// Approximate heap bytes held by the analysis containers. Only the bucket
+// arrays and argument vectors are counted, not allocator overhead, so these
+// are useful for ranking rather than as exact figures.
+template <typename AbstractValue>
+size_t
+approximateStateBytes(const AbstractState<AbstractValue>& state) {
+  return state.getMemorySize();
+}
+
+
+template <typename AbstractValue>
+size_t
+approximateResultBytes(const DataflowResult<AbstractValue>& result) {
+  size_t total = result.getMemorySize();
+  for (auto& kvPair : result) {
+    total += approximateStateBytes<AbstractValue>(kvPair.second);
+  }
+  return total;
+}
+
+
+template <typename AbstractValue, typename AbstractInfo>
+size_t
+approximateSummaryBytes(const Arg2Ret<AbstractValue, AbstractInfo>& summary) {
+  // empty and tombstone keys are vectors too, each holding a single value
+  using Bucket = typename Arg2Ret<AbstractValue, AbstractInfo>::value_type;
+  size_t buckets = summary.getMemorySize() / sizeof(Bucket);
+  size_t total = summary.getMemorySize()
+    + (buckets - summary.size()) * sizeof(AbstractValue);
+  for (auto& kvPair : summary) {
+    total += kvPair.first.capacity() * sizeof(AbstractValue);
+  }
+  return total;
+}
+
+
 template <typename AbstractValue>
 bool
 operator==(const AbstractState<AbstractValue>& s1,
@@ -150,48 +543,343 @@ public:
 };
 
 
+// Whether two abstract values are interchangeable as inputs of a transfer.
+// Values that expose getId() are compared by identity, since their equality
+// may ignore state, such as widening progress, that transfers still read.
+template <typename AbstractValue, typename = void>
+struct SameValue {
+  static bool
+  check(const AbstractValue& v1, const AbstractValue& v2) {
+    return v1 == v2;
+  }
+};
+
+
+template <typename AbstractValue>
+struct SameValue<AbstractValue,
+                 decltype(void(std::declval<const AbstractValue&>().getId()))> {
+  static bool
+  check(const AbstractValue& v1, const AbstractValue& v2) {
+    return v1.getId() == v2.getId();
+  }
+};
+
+
 // This class can be extended with a concrete implementation of the meet
 // operator for two elements of the abstract domain. Implementing the
 // `meetPair()` method in the subclass will enable it to be used within the
 // general meet operator because of the curiously recurring template pattern.
+//
+// The analysis itself meets values in place with `meetInto()`, which by
+// default goes through `meetPair()`. Domains whose values own storage can
+// implement it directly to update the destination without building a new
+// value.
 template <typename AbstractValue, typename SubClass>
 class Meet {
   SubClass& asSubClass() { return static_cast<SubClass&>(*this); };
 public:
   AbstractValue
   operator()(llvm::ArrayRef<AbstractValue> values) {
-    return std::accumulate(values.begin(), values.end(),
-      AbstractValue(),
-      [this] (auto v1, auto v2) {
-        return this->asSubClass().meetPair(v1, v2);
-      });
+    AbstractValue met;
+    meetAll(met, values);
+    return met;
+  }
+
+  // Meet each of values into dst in turn. Returns whether dst changed.
+  template <typename Range>
+  bool
+  meetAll(AbstractValue& dst, const Range& values) {
+    bool changed = false;
+    for (const AbstractValue& value : values) {
+      changed |= asSubClass().meetInto(dst, value);
+    }
+    return changed;
+  }
+
+  // Replace dst with its meet with src. Returns whether dst changed.
+  bool
+  meetInto(AbstractValue& dst, const AbstractValue& src) {
+    AbstractValue met = asSubClass().meetPair(dst, src);
+    if (SameValue<AbstractValue>::check(dst, met)) {
+      return false;
+    }
+    dst = std::move(met);
+    return true;
   }
 
   AbstractValue
-  meetPair(AbstractValue& v1, AbstractValue& v2) const {
+  meetPair(const AbstractValue& v1, const AbstractValue& v2) const {
     llvm_unreachable("unimplemented meet");
   }
 };
 
 
+// Per thread state the values of a domain depend on, e.g. the table their
+// ids index. Domains with such state name it as AbstractValue::Context,
+// which has a static current() returning it on the calling thread and a
+// Scope making it current on another, and regions iterated in parallel make
+// the analysing thread's current on their workers.
+template <typename AbstractValue, typename = void>
+struct ValueContext {
+  using Context = void;
+
+  static Context*
+  current() {
+    return nullptr;
+  }
+
+  struct Scope {
+    explicit Scope(Context*) {}
+  };
+};
+
+
+template <typename AbstractValue>
+struct ValueContext<AbstractValue,
+                    decltype(void(AbstractValue::Context::current()))> {
+  using Context = typename AbstractValue::Context;
+  using Scope = typename Context::Scope;
+
+  static Context*
+  current() {
+    return Context::current();
+  }
+};
+
+
+// How abstract values appear in traces, through operator<< when the value
+// supports it.
+template <typename AbstractValue, typename = void>
+struct DescribeValue {
+  static std::string
+  describe(const AbstractValue& v) {
+    return "?";
+  }
+};
+
+
+template <typename AbstractValue>
+struct DescribeValue<AbstractValue,
+                     decltype(void(std::declval<std::ostream&>()
+                                   << std::declval<const AbstractValue&>()))> {
+  static std::string
+  describe(const AbstractValue& v) {
+    std::ostringstream out;
+    out << v;
+    return out.str();
+  }
+};
+
+
 template <typename AbstractValue,
           typename Transfer,
           typename Meet>
 class ForwardDataflowAnalysis {
+public:
+  // An argument tuple to analyze a function for, along with the context of
+  // the call site it was found at.
+  struct Lane {
+    std::vector<unsigned> context;
+    std::vector<AbstractValue> args;
+  };
+
 private:
   using State  = AbstractState<AbstractValue>;
   using Result = DataflowResult<AbstractValue>;
 
+  // Blocks whose entry state is overridden by the inverse of a comparison,
+  // i.e. the false successor of a bounds checked branch. Their nodes come
+  // from the analysis' arena.
+  using Inversions = std::unordered_map<llvm::BasicBlock*, State,
+    std::hash<llvm::BasicBlock*>, std::equal_to<llvm::BasicBlock*>,
+    ArenaAllocator<std::pair<llvm::BasicBlock* const, State>>>;
+
+  // The working state of a block visit and the inverses of its comparisons.
+  // Kept between visits along with their bucket arrays, so that merging into
+  // them rarely allocates once a few blocks were visited.
+  struct Scratch {
+    State state;
+    llvm::DenseMap<llvm::CmpInst*, State> inverses;
+  };
+
+  // Scratch space no block visit is using. Regions iterated in parallel take
+  // and return it concurrently.
+  class ScratchPool {
+    std::mutex lock;
+    std::vector<std::unique_ptr<Scratch>> idle;
+
+  public:
+    std::unique_ptr<Scratch>
+    take() {
+      std::lock_guard<std::mutex> guard(lock);
+      if (idle.empty()) {
+        return std::unique_ptr<Scratch>(new Scratch);
+      }
+      auto scratch = std::move(idle.back());
+      idle.pop_back();
+      return scratch;
+    }
+
+    void
+    give(std::unique_ptr<Scratch> scratch) {
+      std::lock_guard<std::mutex> guard(lock);
+      idle.push_back(std::move(scratch));
+    }
+  };
+
+  // Scratch space held for the duration of one block visit.
+  class ScratchLease {
+    ScratchPool& pool;
+    std::unique_ptr<Scratch> scratch;
+
+  public:
+    explicit ScratchLease(ScratchPool& pool)
+      : pool(pool), scratch(pool.take()) {}
+    ~ScratchLease() { pool.give(std::move(scratch)); }
+
+    Scratch* operator->() { return scratch.get(); }
+  };
+
   // These property objects determine the behavior of the dataflow analysis.
   // They should by replaced by concrete implementation classes on a per
   // analysis basis.
   Meet meet;
   Transfer transfer;
   std::vector<unsigned> context;
+  FixpointStats* stats;
+
+  // Functions with at least this many blocks are split into regions that are
+  // iterated concurrently on this many threads. Disabled when zero.
+  unsigned parallelBlocks = 0;
+  unsigned threads = 0;
+  std::mutex* serial = nullptr;
+
+  // Closed form values for loop header phis of the function being analyzed.
+  LoopAcceleration<AbstractValue>* acceleration = nullptr;
+  const typename LoopAcceleration<AbstractValue>::HeaderValues* headerValues
+    = nullptr;
+
+  // Last effects of pure instructions, shared with callee analyses.
+  TransferCache<AbstractValue>* effects = nullptr;
+
+  // Values of calls to functions the module does not define, shared with
+  // callee analyses.
+  ExternalCalls<AbstractValue>* externals = nullptr;
+
+  // Which values states carry, shared with callee analyses, and the sets of
+  // the function being analyzed.
+  StateLiveness* liveness = nullptr;
+  const StateLiveness::Sets* liveSets = nullptr;
+
+  // Callees reached with up to this many argument tuples from one block are
+  // analyzed together in a single traversal.
+  unsigned laneWidth = 1;
+
+  // Where spans and events are recorded, shared with callee analyses.
+  FixpointTrace* trace = nullptr;
+
+  // Decides which summaries stay in memory, shared with callee analyses.
+  SummaryStore<AbstractValue>* summaryStore = nullptr;
+  llvm::DenseMap<llvm::BasicBlock*, unsigned> blockNumbers;
+
+  // Storage private to this analysis, released in one go when it completes.
+  // Results outlive the analysis, so they are never drawn from it.
+  llvm::BumpPtrAllocator arena;
+  ScratchPool scratch;
+
+  static std::string
+  describeContext(const std::vector<unsigned>& callsites) {
+    std::string described;
+    for (unsigned callsite : callsites) {
+      described += (described.empty() ? "" : ":") + std::to_string(callsite);
+    }
+    return described;
+  }
+
+  static std::string
+  describeArgs(const std::vector<AbstractValue>& args) {
+    std::string described = "(";
+    for (auto& arg : args) {
+      described += (described.size() > 1 ? ", " : "")
+        + DescribeValue<AbstractValue>::describe(arg);
+    }
+    return described + ")";
+  }
+
+  void
+  traceSummary(llvm::Function* callee, const char* outcome,
+               const std::vector<AbstractValue>& args) {
+    trace->instant("summary", callee->getName().str(), TraceArgs()
+      .add("outcome", outcome)
+      .add("context", describeContext(context))
+      .add("args", describeArgs(args)));
+  }
+
+  void
+  traceAnalysis(llvm::Function& f, uint64_t start,
+                const std::vector<unsigned>& callsites,
+                const std::vector<AbstractValue>& args) {
+    if (trace) {
+      trace->span("analysis", f.getName().str(), TraceArgs()
+        .add("context", describeContext(callsites))
+        .add("args", describeArgs(args)), start);
+    }
+  }
+
+  void
+  numberBlocks(llvm::Function& f) {
+    if (trace && blockNumbers.empty()) {
+      for (auto& bb : f) {
+        blockNumbers.insert({&bb, blockNumbers.size()});
+      }
+    }
+  }
+
+  void
+  countVisit() {
+    if (stats) {
+      stats->blockVisits++;
+    }
+    if (summaryStore) {
+      std::unique_lock<std::mutex> guard = exclusive();
+      summaryStore->visited();
+    }
+  }
+
+  // The lock of what regions iterated in parallel share, or no lock when
+  // blocks are visited one at a time.
+  std::unique_lock<std::mutex>
+  exclusive() {
+    return serial ? std::unique_lock<std::mutex>(*serial)
+                  : std::unique_lock<std::mutex>();
+  }
+
+  template <typename AbInfo>
+  bool
+  hasSummary(Summary<AbstractValue, AbInfo>& summaries, llvm::Function* f,
+             const std::vector<AbstractValue>& args, bool count) {
+    if (summaryStore) {
+      return summaryStore->lookup(f, args, count);
+    }
+    auto& known = summaries[f];
+    return known.end() != known.find(args);
+  }
+
+  // Callees are analyzed in the caller's context while the context holds at
+  // most this many call sites. Deeper calls, and every call when negative,
+  // return Top.
+  int maxContextDepth = 2;
+
+  // Callees are analyzed once, with Top arguments and without a context, and
+  // that summary is taken at every call; maxContextDepth does not apply.
+  bool topArguments = false;
 
-  State
-  mergeStateFromPredecessors(llvm::BasicBlock* bb, Result& results) {
-    auto mergedState = State{};
+  // Values that are not live into bb are left out when live is given.
+  void
+  mergeStateFromPredecessors(llvm::BasicBlock* bb, Result& results,
+                             State& mergedState,
+                             const llvm::BitVector* live) {
+    mergedState.clear();
     for (auto* p : llvm::predecessors(bb)) {
       auto predecessorFacts = results.find(p->getTerminator());
       if (results.end() == predecessorFacts) {
@@ -200,17 +888,38 @@ private:
 
       auto& toMerge = predecessorFacts->second;
       for (auto& valueStatePair : toMerge) {
+        if (live && !liveSets->isLive(*live, valueStatePair.first)) {
+          continue;
+        }
         // If an incoming Value has an AbstractValue in the already merged
         // state, meet it with the new one. Otherwise, copy the new value over,
         // implicitly meeting with bottom.
         auto found = mergedState.insert(valueStatePair);
         if (!found.second) {
-          found.first->second =
-            meet({found.first->second, valueStatePair.second});
+          meet.meetInto(found.first->second, valueStatePair.second);
         }
       }
     }
-    return mergedState;
+  }
+
+  // Copy src over dst. Assigning a DenseMap always frees its buckets and
+  // allocates new ones, while revisits overwrite states with states of about
+  // the same size, so dst's buckets are refilled in place whenever they hold
+  // src without growing. clear() itself shrinks sparse maps of over 64
+  // buckets, which are simply assigned.
+  static void
+  assignState(State& dst, const State& src) {
+    size_t bucket = sizeof(typename State::value_type);
+    size_t buckets = dst.getMemorySize() / bucket;
+    bool sparse = buckets > 64 && dst.size() * 4 < buckets;
+    if (sparse || buckets < src.getMemorySize() / bucket) {
+      dst = src;
+      return;
+    }
+    dst.clear();
+    for (auto& valueStatePair : src) {
+      dst.insert(valueStatePair);
+    }
   }
 
   AbstractValue
@@ -219,10 +928,10 @@ private:
     for (auto& value : phi.incoming_values()) {
       auto found = state.find(value.get());
       if (state.end() != found) {
-        phiValue = meet({phiValue, found->second});
+        meet.meetInto(phiValue, found->second);
       }
       else if (llvm::Constant* c = llvm::dyn_cast<llvm::Constant>(value.get())) {
-        phiValue = meet({phiValue, AbstractValue(c)});
+        meet.meetInto(phiValue, AbstractValue(c));
       }
     }
     return phiValue;
@@ -230,28 +939,100 @@ private:
 
   void
   applyTransfer(llvm::Instruction& i, State& state) {
-    // All phis are explicit meet operations
+    // All phis are explicit meet operations, except for loop headers whose
+    // values are known in closed form
     if (auto* phi = llvm::dyn_cast<llvm::PHINode>(&i)) {
-      state[phi] = meetOverPHI(state, *phi);
+      if (headerValues && headerValues->count(phi)) {
+        state[phi] = headerValues->lookup(phi);
+      }
+      else {
+        state[phi] = meetOverPHI(state, *phi);
+      }
     }
     else {
       transfer(i, state, context);
     }
   }
 
-public:
-  ForwardDataflowAnalysis (std::vector<unsigned> callsites = {}) : context(callsites) {}
+  // Binary operators, casts and phis only read their operands and write
+  // themselves, or operands a transfer defaults when they are missing, so
+  // their effect can be replayed for as long as their operands are unchanged.
+  static bool
+  isCacheable(const llvm::Instruction& i) {
+    return llvm::isa<llvm::BinaryOperator>(i) || llvm::isa<llvm::CastInst>(i)
+      || llvm::isa<llvm::PHINode>(i);
+  }
 
-  template <typename AbInfo>
-  DataflowResult<AbstractValue>
-  computeForwardDataflow(Summary<AbstractValue, AbInfo>& summaries, llvm::Function& f, std::vector<AbstractValue>& Args) {
-    // First compute the initial outgoing state of all instructions
+  static bool
+  sameInput(const std::pair<bool, AbstractValue>& input, const State& state,
+            llvm::Value* v) {
+    auto found = state.find(v);
+    if (state.end() == found) {
+      return !input.first;
+    }
+    return input.first
+      && SameValue<AbstractValue>::check(input.second, found->second);
+  }
+
+  // Returns true if the effect was replayed rather than computed.
+  bool
+  applyCachedTransfer(llvm::Instruction& i, State& state) {
+    if (auto* cached = effects->lookup(&i)) {
+      unsigned index = 0;
+      bool unchanged = true;
+      for (auto& op : i.operands()) {
+        unchanged = unchanged
+          && sameInput(cached->inputs[index++], state, op.get());
+      }
+      if (unchanged) {
+        for (auto& write : cached->writes) {
+          state[write.first] = write.second;
+        }
+        return true;
+      }
+    }
+
+    std::vector<std::pair<bool, AbstractValue>> inputs;
+    for (auto& op : i.operands()) {
+      auto found = state.find(op.get());
+      inputs.push_back(state.end() == found
+        ? std::make_pair(false, AbstractValue())
+        : std::make_pair(true, found->second));
+    }
+
+    applyTransfer(i, state);
+
+    auto& effect = effects->record(&i);
+    effect.writes.clear();
+    unsigned index = 0;
+    for (auto& op : i.operands()) {
+      if (!sameInput(inputs[index++], state, op.get())) {
+        effect.writes.push_back({op.get(), state.find(op.get())->second});
+      }
+    }
+    auto self = state.find(&i);
+    if (state.end() != self) {
+      effect.writes.push_back({&i, self->second});
+    }
+    effect.inputs = std::move(inputs);
+    return false;
+  }
+
+  static Result
+  initialResults(llvm::Function& f) {
     Result results;
+    for (auto& bb : f) {
+      results.FindAndConstruct(&bb);
+    }
     for (auto& i : llvm::instructions(f)) {
       results.FindAndConstruct(&i);
     }
+    return results;
+  }
 
-    // Associate function arguments with aggregate abstraction
+  // Associate function arguments with aggregate abstraction
+  static State
+  argumentState(llvm::Function& f, std::vector<AbstractValue>& Args) {
     llvm::Function::arg_iterator arg = f.arg_begin();
     State ogState;
     for (size_t i = 0; i < Args.size() && arg != f.arg_end(); i++) {
@@ -261,170 +1042,691 @@ public:
       }
       arg++;
     }
+    return ogState;
+  }
 
-    // Add all blocks to the worklist in topological order for efficiency
-    llvm::ReversePostOrderTraversal<llvm::Function*> rpot(&f);
-    WorkList work(rpot.begin(), rpot.end());
-
-    std::unordered_map<llvm::CmpInst*, State> inverses;
-    std::unordered_map<llvm::BasicBlock*, State> blockInversion;
-
-    while (!work.empty()) {
-      auto* bb = work.take();
+  static AbstractValue
+  argumentValue(llvm::Value* a, const State& state) {
+    auto possibleState = state.find(a);
+    if (state.end() != possibleState) {
+      return possibleState->second;
+    }
+    else if (llvm::Constant* c = llvm::dyn_cast<llvm::Constant>(a)) {
+      return AbstractValue(c);
+    }
+    // not a constant, nor a stated variable, so it's undefined
+    return AbstractValue();
+  }
 
-      // Save a copy of the outgoing abstract state to check for changes.
-      const auto& oldEntryState = results[bb];
-      const auto oldExitState   = results[bb->getTerminator()];
+  // Ask externals for the value of a call to a function defined elsewhere.
+  void
+  resolveExternal(llvm::CallInst& call, State& state) {
+    optional<unsigned> callsiteno = getLineNumber(call);
+    if ((int)context.size() > maxContextDepth || !callsiteno
+        || call.getCalledFunction()->isIntrinsic()) {
+      return;
+    }
+    std::vector<AbstractValue> argav;
+    for (unsigned a = 0; a < call.getNumArgOperands(); a++) {
+      argav.push_back(argumentValue(call.getArgOperand(a), state));
+    }
+    if (argav.empty()) {
+      argav.push_back(AbstractValue());
+    }
+    std::vector<unsigned> concpy = context;
+    concpy.push_back(callsiteno.value());
+    AbstractValue result;
+    if (externals->resolve(call, argav, concpy, result)
+        && (nullptr == liveSets || liveSets->isTracked(&call))) {
+      state[&call] = result;
+    }
+  }
 
-      // Merge the state coming in from all predecessors
-      auto state = mergeStateFromPredecessors(bb, results);
+  // Add later calls to the same callee in the block to a batch, as long as
+  // their arguments already have the values they will have at the call:
+  // neither the first call nor anything between the two defines them or
+  // refines them through a comparison. Their summaries are claimed as for recursive calls, so the
+  // calls find them once the batch converged.
+  template <typename AbInfo>
+  void
+  batchLaterCalls(llvm::CallInst& call, const State& state,
+                  Summary<AbstractValue, AbInfo>& summaries,
+                  std::vector<Lane>& batch) {
+    llvm::Function* func = call.getCalledFunction();
+    llvm::DenseSet<llvm::Value*> changing;
+    changing.insert(&call);
+    for (auto it = std::next(call.getIterator()), end = call.getParent()->end();
+         it != end && batch.size() < laneWidth; ++it) {
+      llvm::Instruction& later = *it;
+      auto* next = llvm::dyn_cast<llvm::CallInst>(&later);
+      optional<unsigned> callsiteno = getLineNumber(later);
+      if (next && next->getCalledFunction() == func && callsiteno) {
+        std::vector<AbstractValue> args;
+        bool ready = true;
+        for (unsigned a = 0; a < next->getNumArgOperands() && ready; a++) {
+          llvm::Value* arg = next->getOperand(a);
+          ready = 0 == changing.count(arg);
+          args.push_back(argumentValue(arg, state));
+        }
+        if (args.empty()) {
+          args.push_back(AbstractValue());
+        }
+        if (ready && !hasSummary(summaries, func, args, false)) {
+          summaries[func][args] = AbstractValue();
+          std::vector<unsigned> concpy = context;
+          concpy.push_back(callsiteno.value());
+          batch.push_back({concpy, args});
+        }
+      }
+      if (auto* comp = llvm::dyn_cast<llvm::CmpInst>(&later)) {
+        changing.insert(comp->getOperand(0));
+        changing.insert(comp->getOperand(1));
+      }
+      changing.insert(&later);
+    }
+  }
 
-      // take the inverse of values if this block is an else block or exit block (exits will phi regardless)
-      const auto candidateInversion = blockInversion.find(bb);
-      if (blockInversion.end() != candidateInversion) {
-        for (auto valuePair : candidateInversion->second) {
-          state[valuePair.first] = valuePair.second;
+  // Propagate the abstract state through a single block. Returns true if the
+  // outgoing state changed and the successors of the block must be revisited.
+  template <typename AbInfo>
+  bool
+  propagateBlock(llvm::BasicBlock* bb, Result& results,
+                 Inversions& blockInversion, const State& ogState,
+                 Summary<AbstractValue, AbInfo>& summaries,
+                 llvm::Function& f, std::vector<AbstractValue>& Args) {
+    const auto& oldEntryState = results[bb];
+    auto* terminator = bb->getTerminator();
+
+    // Merge the state coming in from all predecessors
+    ScratchLease lease(scratch);
+    State& state = lease->state;
+    const llvm::BitVector* liveIn =
+      liveSets ? &liveSets->liveIn.find(bb)->second : nullptr;
+    mergeStateFromPredecessors(bb, results, state, liveIn);
+
+    // take the inverse of values if this block is an else block or exit block (exits will phi regardless)
+    const auto candidateInversion = blockInversion.find(bb);
+    if (blockInversion.end() != candidateInversion) {
+      for (auto valuePair : candidateInversion->second) {
+        if (liveIn && !liveSets->isLive(*liveIn, valuePair.first)) {
+          continue;
         }
+        state[valuePair.first] = valuePair.second;
       }
+    }
 
-      // If we have already processed the block and no changes have been made to
-      // the abstract input, we can skip processing the block. Otherwise, save
-      // the new entry state and proceed processing this block.
-      if (state == oldEntryState && !state.empty()) {
+    // If we have already processed the block and no changes have been made to
+    // the abstract input, we can skip processing the block. Otherwise, save
+    // the new entry state and proceed processing this block.
+    if (state == oldEntryState && !state.empty()) {
+      return false;
+    }
+    assignState(results[bb], state);
+    for (auto oparam : ogState) {
+      if (liveIn && !liveSets->isLive(*liveIn, oparam.first)) {
         continue;
       }
-      results[bb] = state;
-      for (auto oparam : ogState) {
-        if (state.end() != state.find(oparam.first)) break;
-        state[oparam.first] = oparam.second;
-      }
+      if (state.end() != state.find(oparam.first)) break;
+      state[oparam.first] = oparam.second;
+    }
 
-      bool boundChecked = false;
-      inverses.clear();
+    bool boundChecked = false;
+    bool exitChanged = false;
+    unsigned long replayed = 0;
+    // inverses of comparisons left from earlier visits are emptied rather
+    // than erased, which reads the same as a missing one
+    auto& inverses = lease->inverses;
+    for (auto& inverse : inverses) {
+      inverse.second.clear();
+    }
+    if (stats) {
+      stats->transfers += bb->size();
+    }
 
-      // Propagate through all instructions in the block
-      for (auto& i : *bb) {
-        if (auto* call = llvm::dyn_cast<llvm::CallInst>(&i)) {
-          llvm::Function* func = call->getCalledFunction();
-          if (func->isDeclaration()) {
-          	continue;
+    // Propagate through all instructions in the block
+    for (auto& i : *bb) {
+      // While regions are iterated in parallel, only what reaches beyond the
+      // block's own state is serialized: the summaries and the analyses of
+      // callees, the transfer cache, and transfers, which may touch the
+      // LLVMContext and the reports. Comparisons, phis and the state copies
+      // below run concurrently.
+      std::unique_lock<std::mutex> guard;
+
+      if (auto* call = llvm::dyn_cast<llvm::CallInst>(&i)) {
+        guard = exclusive();
+        llvm::Function* func = call->getCalledFunction();
+        if (func->isDeclaration()) {
+          if (externals) {
+            resolveExternal(*call, state);
           }
-          unsigned nargs = call->getNumArgOperands();
-          std::vector<AbstractValue> argav;
-          for (unsigned i = 0; i < nargs; i++) {
-            llvm::Value* a = call->getOperand(i);
-            auto possibleState = state.find(a);
-            if (state.end() != possibleState) {
-              argav.push_back(possibleState->second);
-            }
-            else if (llvm::Constant* c = llvm::dyn_cast<llvm::Constant>(a)) {
-              argav.push_back(AbstractValue(c));
-            }
-            else { // not a constant, nor a stated variable, so it's undefined
-              argav.push_back(AbstractValue());
-            }
-          }
-          // push an undefined in if call has no arguments
-          if (argav.empty()) {
+          continue;
+        }
+        unsigned nargs = call->getNumArgOperands();
+        std::vector<AbstractValue> argav;
+        for (unsigned i = 0; i < nargs; i++) {
+          if (topArguments) {
+            // one summary for every call, whatever its arguments
             argav.push_back(AbstractValue());
+            argav.back().makeTop();
+          }
+          else {
+            argav.push_back(argumentValue(call->getOperand(i), state));
           }
-          if (summaries[func].end() == summaries[func].find(argav)) {
-            summaries[func][argav] = AbstractValue(); // default function return state to undefined in case of recursive calls
-            if (context.size() <= 2) { // fixed depth of 2 to bound for efficiency (todo: make main argument?)
-              // deeper analyze of func
-              optional<unsigned> callsiteno = getLineNumber(i);
-              if (callsiteno) { // only proceed if we have context info, otherwise don't proceed
-                std::vector<unsigned> concpy = context;
+        }
+        // push an undefined in if call has no arguments
+        if (argav.empty()) {
+          argav.push_back(AbstractValue());
+        }
+        bool cached = hasSummary(summaries, func, argav, true);
+        if (trace && cached) {
+          traceSummary(func, "hit", argav);
+        }
+        std::vector<Lane> batch;
+        unsigned long visitsBefore =
+          summaryStore ? summaryStore->visitCount() : 0;
+        if (!cached) {
+          summaries[func][argav] = AbstractValue(); // default function return state to undefined in case of recursive calls
+          if (topArguments || (int)context.size() <= maxContextDepth) { // bounded for efficiency
+            // deeper analyze of func
+            optional<unsigned> callsiteno = getLineNumber(i);
+            if (topArguments || callsiteno) { // only proceed if we have context info, otherwise don't proceed
+              // with Top arguments the callee is analyzed once, as the
+              // module's own functions are, without a context
+              std::vector<unsigned> concpy;
+              if (!topArguments) {
+                concpy = context;
                 concpy.push_back(callsiteno.value());
-                ForwardDataflowAnalysis<AbstractValue, Transfer, Meet> analysis(concpy);
+              }
+              ForwardDataflowAnalysis<AbstractValue, Transfer, Meet>
+                analysis(concpy, stats, transfer);
+              analysis.acceleration = acceleration;
+              analysis.effects = effects;
+              analysis.liveness = liveness;
+              analysis.externals = externals;
+              analysis.maxContextDepth = maxContextDepth;
+              analysis.topArguments = topArguments;
+              analysis.laneWidth = laneWidth;
+              analysis.trace = trace;
+              analysis.summaryStore = summaryStore;
+              if (laneWidth > 1 && !topArguments) {
+                batch.push_back({concpy, argav});
+                batchLaterCalls<AbInfo>(*call, state, summaries, batch);
+              }
+              if (trace) {
+                traceSummary(func, batch.size() > 1 ? "batched" : "analyze",
+                             argav);
+              }
+              if (batch.size() > 1) {
+                analysis.computeForwardDataflowLanes<AbInfo>(summaries, *func,
+                                                             batch);
+              }
+              else {
                 analysis.computeForwardDataflow<AbInfo>(summaries, *func, argav);
               }
             }
-            else {
-              // define summaries[func][argav] as Top to differentiate errors in function
-              summaries[func][argav].makeTop();
+            else if (trace) {
+              traceSummary(func, "no debug location", argav);
+            }
+          }
+          else {
+            // define summaries[func][argav] as Top to differentiate errors in function
+            summaries[func][argav].makeTop();
+            if (trace) {
+              traceSummary(func, "depth limit", argav);
             }
           }
+        }
+        if (nullptr == liveSets || liveSets->isTracked(call)) {
           state[call] = summaries[func][argav];
         }
-        else if (auto* ret = llvm::dyn_cast<llvm::ReturnInst>(&i)) {
-          llvm::Value* retv = ret->getReturnValue();
-          if (llvm::Constant* c = llvm::dyn_cast<llvm::Constant>(retv)) {
-            summaries[&f][Args] = AbstractValue(c);
+        if (summaryStore && !cached) {
+          // handed over after the result is read, since the store may drop
+          // any summary it holds, including the ones just admitted
+          unsigned long cost = summaryStore->visitCount() - visitsBefore;
+          if (batch.empty()) {
+            summaryStore->admit(func, argav, cost);
+          }
+          for (auto& lane : batch) {
+            summaryStore->admit(func, lane.args, cost / batch.size());
+          }
+        }
+      }
+      else if (auto* ret = llvm::dyn_cast<llvm::ReturnInst>(&i)) {
+        guard = exclusive();
+        llvm::Value* retv = ret->getReturnValue();
+        if (llvm::Constant* c = llvm::dyn_cast<llvm::Constant>(retv)) {
+          summaries[&f][Args] = AbstractValue(c);
+        }
+        else {
+          auto retav = state.find(retv);
+          if (state.end() == retav) {
+            summaries[&f][Args] = AbstractValue();
           }
           else {
-            auto retav = state.find(retv);
-            if (state.end() == retav) {
-              summaries[&f][Args] = AbstractValue();
-            }
-            else {
-              summaries[&f][Args] = retav->second;
+            summaries[&f][Args] = retav->second;
+          }
+        }
+      }
+      // control block analysis based on conditions and mapped bounds
+      else if (auto* comp = llvm::dyn_cast<llvm::CmpInst>(&i)) {
+        llvm::Value* lhs = comp->getOperand(0);
+        llvm::Value* rhs = comp->getOperand(1);
+
+        llvm::Constant* lc = llvm::dyn_cast<llvm::Constant>(lhs);
+        llvm::Constant* rc = llvm::dyn_cast<llvm::Constant>(rhs);
+        if (lc && rc) continue; // comparing 2 constants... ok...
+
+        auto ldep = state.find(lhs);
+        auto rdep = state.find(rhs);
+        llvm::CmpInst::Predicate main = comp->getPredicate();
+        llvm::CmpInst::Predicate other = comp->getInversePredicate(comp->getPredicate());
+
+        // deduce lhs or rhs intervals to preserve variable abstraction in successor blocks
+        if ((state.end() != ldep && state.end() != rdep) ||
+            (nullptr == lc && nullptr == rc)) {
+          state[ldep->first] = AbstractValue(rdep->second, main, &ldep->second);
+          state[rdep->first] = AbstractValue(ldep->second, main, &rdep->second);
+
+          // inverses
+          inverses[comp][ldep->first] = AbstractValue(rdep->second, other, &ldep->second);
+          inverses[comp][rdep->first] = AbstractValue(ldep->second, other, &rdep->second);
+        }
+        // define states for true block
+        else if (state.end() != ldep && rc) {
+          state[ldep->first] = AbstractValue(rc, main, &ldep->second);
+
+          inverses[comp][ldep->first] = AbstractValue(rc, other, &ldep->second);
+        }
+        else if (state.end() != rdep && lc) {
+
+          state[rdep->first] = AbstractValue(lc, main, &rdep->second);
+
+          inverses[comp][rdep->first] = AbstractValue(lc, other, &rdep->second);
+        }
+      }
+      else if (llvm::BranchInst* br = llvm::dyn_cast<llvm::BranchInst>(&i)) {
+        if (br->isConditional()) {
+          llvm::Value* cond = br->getCondition();
+          if (state.end() == state.find(cond)) {
+            boundChecked = true; // continue to the next block, since we have the condition variable's bounds already set
+
+            if (br->getNumSuccessors() > 1) {
+              if (llvm::CmpInst *cmp = llvm::dyn_cast<llvm::CmpInst>(cond)) {
+                llvm::BasicBlock *ibb = br->getSuccessor(1);
+                // regions running side by side may branch to the same block
+                guard = exclusive();
+                blockInversion[ibb] = inverses[cmp];
+              }
             }
           }
         }
-        // control block analysis based on conditions and mapped bounds
-        else if (auto* comp = llvm::dyn_cast<llvm::CmpInst>(&i)) {
-          llvm::Value* lhs = comp->getOperand(0);
-          llvm::Value* rhs = comp->getOperand(1);
-
-          llvm::Constant* lc = llvm::dyn_cast<llvm::Constant>(lhs);
-          llvm::Constant* rc = llvm::dyn_cast<llvm::Constant>(rhs);
-          if (lc && rc) continue; // comparing 2 constants... ok...
-
-          auto ldep = state.find(lhs);
-          auto rdep = state.find(rhs);
-          llvm::CmpInst::Predicate main = comp->getPredicate();
-          llvm::CmpInst::Predicate other = comp->getInversePredicate(comp->getPredicate());
-
-          // deduce lhs or rhs intervals to preserve variable abstraction in successor blocks
-          if ((state.end() != ldep && state.end() != rdep) ||
-              (nullptr == lc && nullptr == rc)) {
-            state[ldep->first] = AbstractValue(rdep->second, main, &ldep->second);
-            state[rdep->first] = AbstractValue(ldep->second, main, &rdep->second);
-
-            // inverses
-            inverses[comp][ldep->first] = AbstractValue(rdep->second, other, &ldep->second);
-            inverses[comp][rdep->first] = AbstractValue(ldep->second, other, &rdep->second);
+      }
+      else if (liveSets && isCacheable(i) && !liveSets->isTracked(&i)
+               && !liveSets->tracksOperandOf(i)) {
+        // Nothing reads it, nor is there an operand its transfer could
+        // default that anything reads.
+      }
+      else if (effects && isCacheable(i)) {
+        guard = exclusive();
+        replayed += applyCachedTransfer(i, state);
+      }
+      else {
+        // phis only meet values of the state
+        if (!llvm::isa<llvm::PHINode>(i)) {
+          guard = exclusive();
+        }
+        applyTransfer(i, state);
+      }
+      if (guard.owns_lock()) {
+        guard.unlock();
+      }
+      if (liveSets && !liveSets->isTracked(&i)) {
+        state.erase(&i);
+      }
+      // Nothing else writes the terminator's state during the visit, so the
+      // outgoing state is compared just before it is overwritten rather than
+      // against a copy taken on entry. Values dead in every successor are
+      // dropped first.
+      if (&i == terminator) {
+        if (liveSets) {
+          const llvm::BitVector& liveOut = liveSets->liveOut.find(bb)->second;
+          for (auto it = state.begin(), end = state.end(); it != end; ) {
+            auto valueStatePair = it++;
+            if (!liveSets->isLive(liveOut, valueStatePair->first)) {
+              state.erase(valueStatePair);
+            }
           }
-          // define states for true block
-          else if (state.end() != ldep && rc) {
-            state[ldep->first] = AbstractValue(rc, main, &ldep->second);
+        }
+        exitChanged = !(state == results[&i]);
+      }
+      assignState(results[&i], state);
+    }
 
-            inverses[comp][ldep->first] = AbstractValue(rc, other, &ldep->second);
-          }
-          else if (state.end() != rdep && lc) {
+    // If the abstract state for this block did not change, then we are done
+    // with this block. Otherwise, we must update the abstract state and
+    // consider changes to successors.
+    if (stats) {
+      stats->transfers -= replayed;
+    }
+    return exitChanged && !boundChecked;
+  }
+
+  // propagateBlock, recorded as a span when tracing
+  template <typename AbInfo>
+  bool
+  visitBlock(llvm::BasicBlock* bb, Result& results,
+             Inversions& blockInversion, const State& ogState,
+             Summary<AbstractValue, AbInfo>& summaries,
+             llvm::Function& f, std::vector<AbstractValue>& Args) {
+    if (nullptr == trace) {
+      return propagateBlock<AbInfo>(bb, results, blockInversion, ogState,
+                                    summaries, f, Args);
+    }
+    uint64_t start = trace->now();
+    bool changed = propagateBlock<AbInfo>(bb, results, blockInversion,
+                                          ogState, summaries, f, Args);
+    trace->span("block", bb->hasName()
+        ? bb->getName().str()
+        : "block " + std::to_string(blockNumbers.lookup(bb)),
+      TraceArgs()
+        .add("function", f.getName())
+        .add("context", describeContext(context))
+        .flag("changed", changed),
+      start);
+    return changed;
+  }
+
+  // Decompose the CFG into its strongly connected regions. The regions form a
+  // DAG, so each region can be iterated to its own fixpoint once every region
+  // feeding it has converged, and independent regions can run concurrently.
+  // Results from predecessor regions are joined at region entries by the
+  // usual merge. Every key of the results and inversion maps exists before
+  // any task starts, so tasks only write to existing entries and the maps are
+  // never rehashed underneath another thread.
+  template <typename AbInfo>
+  void
+  propagateRegions(llvm::ReversePostOrderTraversal<llvm::Function*>& rpot,
+                   Result& results, Inversions& blockInversion,
+                   const State& ogState,
+                   Summary<AbstractValue, AbInfo>& summaries,
+                   llvm::Function& f, std::vector<AbstractValue>& Args) {
+    llvm::DenseMap<llvm::BasicBlock*, unsigned> order;
+    for (auto* bb : rpot) {
+      unsigned index = order.size();
+      order[bb] = index;
+      blockInversion[bb];
+    }
 
-            state[rdep->first] = AbstractValue(lc, main, &rdep->second);
+    // scc_iterator produces regions in reverse topological order
+    std::vector<std::vector<llvm::BasicBlock*>> regions;
+    for (auto scc = llvm::scc_begin(&f); !scc.isAtEnd(); ++scc) {
+      regions.push_back(*scc);
+    }
+    std::reverse(regions.begin(), regions.end());
+
+    llvm::DenseMap<llvm::BasicBlock*, unsigned> regionOf;
+    for (unsigned r = 0; r < regions.size(); r++) {
+      // seed each region's worklist in topological order as well
+      std::sort(regions[r].begin(), regions[r].end(),
+        [&order] (llvm::BasicBlock* b1, llvm::BasicBlock* b2) {
+          return order.lookup(b1) < order.lookup(b2);
+        });
+      for (auto* bb : regions[r]) {
+        regionOf[bb] = r;
+      }
+    }
 
-            inverses[comp][rdep->first] = AbstractValue(lc, other, &rdep->second);
+    std::vector<std::vector<unsigned>> exits(regions.size());
+    std::unique_ptr<std::atomic<unsigned>[]> pending(
+      new std::atomic<unsigned>[regions.size()]);
+    for (unsigned r = 0; r < regions.size(); r++) {
+      pending[r] = 0;
+    }
+    for (unsigned r = 0; r < regions.size(); r++) {
+      for (auto* bb : regions[r]) {
+        for (auto* s : llvm::successors(bb)) {
+          unsigned next = regionOf.lookup(s);
+          if (next != r) {
+            exits[r].push_back(next);
           }
         }
-        else if (llvm::BranchInst* br = llvm::dyn_cast<llvm::BranchInst>(&i)) {
-          if (br->isConditional()) {
-            llvm::Value* cond = br->getCondition();
-            if (state.end() == state.find(cond)) {
-              boundChecked = true; // continue to the next block, since we have the condition variable's bounds already set
-
-              if (br->getNumSuccessors() > 1) {
-                if (llvm::CmpInst *cmp = llvm::dyn_cast<llvm::CmpInst>(cond)) {
-                  llvm::BasicBlock *ibb = br->getSuccessor(1);
-                  blockInversion[ibb] = inverses[cmp];
-                }
-              }
-            }
+      }
+      std::sort(exits[r].begin(), exits[r].end());
+      exits[r].erase(std::unique(exits[r].begin(), exits[r].end()),
+                     exits[r].end());
+      for (unsigned next : exits[r]) {
+        pending[next]++;
+      }
+    }
+
+    std::mutex transferLock;
+    serial = &transferLock;
+    llvm::ThreadPool pool(threads
+      ? threads
+      : std::max(1u, std::thread::hardware_concurrency()));
+
+    auto* valueContext = ValueContext<AbstractValue>::current();
+    std::function<void(unsigned)> iterateRegion = [&] (unsigned r) {
+      FixpointTrace::Scope traced(trace);
+      typename ValueContext<AbstractValue>::Scope valued(valueContext);
+      WorkList work(regions[r].begin(), regions[r].end());
+      while (!work.empty()) {
+        auto* bb = work.take();
+        countVisit();
+        if (!visitBlock<AbInfo>(bb, results, blockInversion, ogState,
+                                summaries, f, Args)) {
+          continue;
+        }
+        for (auto* s : llvm::successors(bb)) {
+          if (regionOf.lookup(s) == r) {
+            work.add(s);
           }
         }
-        else {
-          applyTransfer(i, state);
+      }
+
+      // a successor region starts once all of its incoming regions converged
+      for (unsigned next : exits[r]) {
+        if (0 == --pending[next]) {
+          pool.async([&iterateRegion, next] { iterateRegion(next); });
         }
-        results[&i] = state;
       }
+    };
+
+    for (unsigned r = 0; r < regions.size(); r++) {
+      if (0 == pending[r]) {
+        pool.async([&iterateRegion, r] { iterateRegion(r); });
+      }
+    }
+    pool.wait();
+    serial = nullptr;
+  }
+
+public:
+  // Transfers that carry state, such as where to log reports, are passed in
+  // and copied into the analyses of callees.
+  ForwardDataflowAnalysis (std::vector<unsigned> callsites = {},
+                           FixpointStats* stats = nullptr,
+                           Transfer transfer = Transfer())
+    : transfer(transfer), context(callsites), stats(stats) {}
+
+  // Iterate the strongly connected regions of functions with at least
+  // minBlocks blocks concurrently. Callee analyses always run sequentially.
+  void
+  enableRegionParallelism(unsigned minBlocks, unsigned threadCount) {
+    parallelBlocks = minBlocks;
+    threads = threadCount;
+  }
+
+  // Use closed form values for loop header phis where the accelerator knows
+  // them, falling back to meets and widening elsewhere.
+  void
+  enableLoopAcceleration(LoopAcceleration<AbstractValue>* loops) {
+    acceleration = loops;
+  }
+
+  // Replay the last effect of pure instructions whose operands did not
+  // change since they were evaluated, rather than running their transfer.
+  // The transfer must be deterministic for such instructions.
+  void
+  enableTransferCache(TransferCache<AbstractValue>* cache) {
+    effects = cache;
+  }
+
+  // Keep values in states only where they are live, and values that cannot
+  // reach an effect of the analysis not at all.
+  void
+  enableStatePruning(StateLiveness* states) {
+    liveness = states;
+  }
+
+  // Take the values of calls to declared functions from calls.
+  void
+  enableExternalCalls(ExternalCalls<AbstractValue>* calls) {
+    externals = calls;
+  }
+
+  // Bound the call sites in the contexts callees are analyzed in. A negative
+  // depth makes the analysis context insensitive: calls are not followed and
+  // their results are Top.
+  void
+  setMaxContextDepth(int depth) {
+    maxContextDepth = depth;
+  }
+
+  // Analyze each callee once with every argument Top, which covers all of its
+  // calls, and take that summary at each of them instead of following calls
+  // in contexts.
+  void
+  enableTopArguments(bool enable) {
+    topArguments = enable;
+  }
+
+  // Record analyses, block visits and summary lookups, including those of
+  // callees, in the given trace.
+  void
+  enableTrace(FixpointTrace* fixpointTrace) {
+    trace = fixpointTrace;
+  }
+
+  // Keep summaries where the store decides, rather than all of them. The
+  // store must manage the summaries passed to computeForwardDataflow.
+  void
+  enableSummaryStore(SummaryStore<AbstractValue>* store) {
+    summaryStore = store;
+  }
+
+  // Analyze callees for several argument tuples at once when a block calls
+  // them with up to width distinct tuples whose values are known together.
+  void
+  enableLaneBatching(unsigned width) {
+    laneWidth = std::max(1u, width);
+  }
+
+  template <typename AbInfo>
+  DataflowResult<AbstractValue>
+  computeForwardDataflow(Summary<AbstractValue, AbInfo>& summaries, llvm::Function& f, std::vector<AbstractValue>& Args) {
+    if (stats) {
+      stats->analyses++;
+    }
+    FixpointTrace::Scope traced(trace);
+    uint64_t start = trace ? trace->now() : 0;
+    numberBlocks(f);
+
+    // First compute the initial outgoing state of all instructions and the
+    // initial incoming state of all blocks
+    Result results = initialResults(f);
+    State ogState = argumentState(f, Args);
+
+    if (acceleration) {
+      headerValues = &acceleration->headerValuesFor(f);
+    }
+    if (liveness) {
+      liveSets = &liveness->setsFor(f);
+    }
+
+    llvm::ReversePostOrderTraversal<llvm::Function*> rpot(&f);
+    Inversions blockInversion(0, std::hash<llvm::BasicBlock*>(),
+      std::equal_to<llvm::BasicBlock*>(), ArenaAllocator<State>(arena));
+
+    if (parallelBlocks && f.size() >= parallelBlocks) {
+      propagateRegions<AbInfo>(rpot, results, blockInversion, ogState,
+                               summaries, f, Args);
+      traceAnalysis(f, start, context, Args);
+      return results;
+    }
+
+    // Add all blocks to the worklist in topological order for efficiency
+    WorkList work(rpot.begin(), rpot.end());
+
+    while (!work.empty()) {
+      auto* bb = work.take();
+      countVisit();
+      if (!visitBlock<AbInfo>(bb, results, blockInversion, ogState,
+                              summaries, f, Args)) {
+        continue;
+      }
+
+      for (auto* s : llvm::successors(bb)) {
+        work.add(s);
+      }
+    }
+
+    traceAnalysis(f, start, context, Args);
+    return results;
+  }
+
+  // Analyze f for each lane's arguments in its context, sharing a single
+  // worklist. Each block taken from it is propagated for every lane in turn
+  // while its instructions are hot, and its successors are revisited while
+  // any lane still changes; lanes whose entry state is unchanged skip the
+  // block as usual. Results are returned in the order of the lanes.
+  template <typename AbInfo>
+  std::vector<DataflowResult<AbstractValue>>
+  computeForwardDataflowLanes(Summary<AbstractValue, AbInfo>& summaries,
+                              llvm::Function& f, std::vector<Lane>& lanes) {
+    std::vector<Result> results;
+    std::vector<State> ogStates;
+    std::vector<Inversions> blockInversions(lanes.size(),
+      Inversions(0, std::hash<llvm::BasicBlock*>(),
+                 std::equal_to<llvm::BasicBlock*>(),
+                 ArenaAllocator<State>(arena)));
+    FixpointTrace::Scope traced(trace);
+    uint64_t start = trace ? trace->now() : 0;
+    numberBlocks(f);
+    for (auto& lane : lanes) {
+      if (stats) {
+        stats->analyses++;
+      }
+      results.push_back(initialResults(f));
+      ogStates.push_back(argumentState(f, lane.args));
+    }
 
+    if (acceleration) {
+      headerValues = &acceleration->headerValuesFor(f);
+    }
+    if (liveness) {
+      liveSets = &liveness->setsFor(f);
+    }
 
-      // If the abstract state for this block did not change, then we are done
-      // with this block. Otherwise, we must update the abstract state and
-      // consider changes to successors.
-      if (state == oldExitState || boundChecked) {
+    llvm::ReversePostOrderTraversal<llvm::Function*> rpot(&f);
+    WorkList work(rpot.begin(), rpot.end());
+
+    while (!work.empty()) {
+      auto* bb = work.take();
+      if (stats) {
+        stats->takesSaved += lanes.size() - 1;
+      }
+      bool changed = false;
+      for (size_t l = 0; l < lanes.size(); l++) {
+        countVisit();
+        // transfers and nested calls see the lane's context
+        std::swap(context, lanes[l].context);
+        changed |= visitBlock<AbInfo>(bb, results[l], blockInversions[l],
+                                      ogStates[l], summaries, f,
+                                      lanes[l].args);
+        std::swap(context, lanes[l].context);
+      }
+      if (!changed) {
         continue;
       }
 
@@ -433,6 +1735,9 @@ public:
       }
     }
 
+    for (auto& lane : lanes) {
+      traceAnalysis(f, start, lane.context, lane.args);
+    }
     return results;
   }
 };
@@ -0,0 +1,248 @@
+
+//
+// Chrome trace format recording of the fixpoint loop, see FixpointTrace.
+//
+
+#ifndef FIXPOINT_TRACE_H
+#define FIXPOINT_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+
+namespace analysis {
+
+
+// Arguments of a trace event, kept as the body of a JSON object.
+class TraceArgs {
+  std::string json;
+
+  void
+  key(const char* name) {
+    if (!json.empty()) {
+      json += ",";
+    }
+    json += "\"";
+    json += name;
+    json += "\":";
+  }
+
+public:
+  // value as a JSON string literal
+  static std::string
+  quote(llvm::StringRef value) {
+    std::string quoted = "\"";
+    for (char c : value) {
+      switch (c) {
+        case '"':  quoted += "\\\""; break;
+        case '\\': quoted += "\\\\"; break;
+        case '\n': quoted += "\\n"; break;
+        case '\t': quoted += "\\t"; break;
+        default:
+          if (static_cast<unsigned char>(c) < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            quoted += "\\u00";
+            quoted += hex[(c >> 4) & 0xf];
+            quoted += hex[c & 0xf];
+          }
+          else {
+            quoted += c;
+          }
+      }
+    }
+    return quoted + "\"";
+  }
+
+  TraceArgs&
+  add(const char* name, llvm::StringRef value) {
+    key(name);
+    json += quote(value);
+    return *this;
+  }
+
+  TraceArgs&
+  add(const char* name, uint64_t value) {
+    key(name);
+    json += std::to_string(value);
+    return *this;
+  }
+
+  // not an overload of add, which string literals would convert to
+  TraceArgs&
+  flag(const char* name, bool value) {
+    key(name);
+    json += value ? "true" : "false";
+    return *this;
+  }
+
+  const std::string&
+  str() const {
+    return json;
+  }
+};
+
+
+// Records what the fixpoint loop spends its time on as Chrome trace events,
+// which chrome://tracing and Perfetto load directly. Each thread appends to
+// its own buffer, so recording never contends; buffers are only merged by
+// write, which must not run concurrently with an analysis. write releases the
+// events it wrote, and threads forget the buffers of traces written or
+// destroyed the next time they record, so neither outlives its trace.
+//
+// Analyses given a trace record a span per analysis and per block visit,
+// along with the outcome of every summary lookup at a call. While such an
+// analysis runs, active() returns its trace on that thread, so domain code
+// can add events of its own, e.g. when it widens a value. Analyses without
+// a trace pay a pointer test per block and per call.
+class FixpointTrace {
+  struct Event {
+    char phase;           // 'X' for spans, 'i' for instants
+    const char* category;
+    std::string name;
+    std::string args;
+    uint64_t start;       // microseconds since the trace was created
+    uint64_t duration;
+  };
+
+  struct Buffer {
+    unsigned tid;
+    std::vector<Event> events;
+  };
+
+  const uint64_t generation;
+  const std::chrono::steady_clock::time_point origin;
+  std::mutex lock;
+  std::vector<std::shared_ptr<Buffer>> buffers;
+
+  static uint64_t
+  nextGeneration() {
+    static std::atomic<uint64_t> generations{0};
+    return ++generations;
+  }
+
+  // A thread's buffer in some trace. The trace owns the buffer, so the entry
+  // expires once the trace wrote or dropped it.
+  struct Cached {
+    uint64_t generation;
+    Buffer* buffer;
+    std::weak_ptr<Buffer> owner;
+  };
+
+  // Traces are told apart by generation rather than address, so a thread
+  // never appends to the buffer of a destroyed trace at the same address.
+  Buffer&
+  buffer() {
+    thread_local std::vector<Cached> cached;
+    for (auto& entry : cached) {
+      if (entry.generation == generation && !entry.owner.expired()) {
+        return *entry.buffer;
+      }
+    }
+    cached.erase(std::remove_if(cached.begin(), cached.end(),
+      [] (const Cached& entry) { return entry.owner.expired(); }),
+      cached.end());
+    std::lock_guard<std::mutex> guard(lock);
+    buffers.emplace_back(new Buffer{(unsigned)buffers.size() + 1, {}});
+    cached.push_back({generation, buffers.back().get(), buffers.back()});
+    return *cached.back().buffer;
+  }
+
+  static FixpointTrace*&
+  activeSlot() {
+    thread_local FixpointTrace* trace = nullptr;
+    return trace;
+  }
+
+public:
+  FixpointTrace()
+    : generation(nextGeneration()), origin(std::chrono::steady_clock::now()) {}
+
+  FixpointTrace(const FixpointTrace&) = delete;
+
+  FixpointTrace&
+  operator=(const FixpointTrace&) = delete;
+
+  // The trace of the analysis running on this thread, if it has one.
+  static FixpointTrace*
+  active() {
+    return activeSlot();
+  }
+
+  // Makes a trace active on this thread for the lifetime of the scope.
+  class Scope {
+    FixpointTrace* previous;
+
+  public:
+    explicit Scope(FixpointTrace* trace) : previous(activeSlot()) {
+      activeSlot() = trace;
+    }
+
+    ~Scope() {
+      activeSlot() = previous;
+    }
+  };
+
+  uint64_t
+  now() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - origin).count();
+  }
+
+  // A span from start until now. category must outlive the trace.
+  void
+  span(const char* category, std::string name, const TraceArgs& args,
+       uint64_t start) {
+    uint64_t end = now();
+    buffer().events.push_back({'X', category, std::move(name), args.str(),
+                               start, end - start});
+  }
+
+  void
+  instant(const char* category, std::string name, const TraceArgs& args) {
+    buffer().events.push_back({'i', category, std::move(name), args.str(),
+                               now(), 0});
+  }
+
+  // Every event recorded so far, which are then released.
+  void
+  write(std::ostream& out) {
+    std::lock_guard<std::mutex> guard(lock);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (auto& buffer : buffers) {
+      for (auto& event : buffer->events) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"ph\":\"" << event.phase << "\",\"cat\":\""
+            << event.category << "\",\"name\":"
+            << TraceArgs::quote(event.name)
+            << ",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"ts\":" << event.start;
+        if ('X' == event.phase) {
+          out << ",\"dur\":" << event.duration;
+        }
+        else {
+          out << ",\"s\":\"t\"";
+        }
+        out << ",\"args\":{" << event.args << "}}";
+      }
+    }
+    out << "\n]}\n";
+    buffers.clear();
+  }
+};
+
+
+} // end namespace
+
+
+#endif
@@ -0,0 +1,374 @@
+
+#ifndef PRODUCT_ANALYSIS_H
+#define PRODUCT_ANALYSIS_H
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+#include "DataflowAnalysis.h"
+
+
+namespace analysis {
+
+
+// A Product runs several abstract domains within a single
+// ForwardDataflowAnalysis. Its values are tuples of the component values, so
+// the domains share one worklist, one state map keyed by llvm::Value and one
+// set of summaries, and an additional checker costs its own transfers and
+// meets rather than another traversal of every CFG.
+//
+// Each domain is described by its value, transfer, meet and DenseMap info:
+//
+//   using Checkers = analysis::Product<
+//     analysis::Domain<BoundValue, BoundTransfer, BoundMeet, BoundInfo>,
+//     analysis::Domain<RangeValue, RangeTransfer, RangeMeet, RangeInfo>>;
+//
+//   analysis::ForwardDataflowAnalysis<Checkers::Value,
+//                                     Checkers::Transfer,
+//                                     Checkers::Meet> analysis(
+//     {}, &stats, Checkers::Transfer(boundTransfer, rangeTransfer));
+//   analysis.computeForwardDataflow<Checkers::Info>(summaries, f, args);
+//
+// Component transfers run on the shared state itself, through a
+// ComponentState that presents one component of every tuple as if the state
+// held that domain alone. They are therefore templates on the state they
+// update. Meets are taken component by component, in place. Entries of the
+// state are shared: a value one domain enters is present, undefined, for the
+// others.
+//
+// Domains exchange facts through a reduction, which runs after the transfers
+// of every instruction and may refine any component of the state from the
+// others, e.g. narrowing a null check with a known interval. ReducedProduct
+// takes the reduction as its first parameter.
+template <typename AbstractValue,
+          typename Transfer,
+          typename Meet,
+          typename AbstractInfo>
+struct Domain {
+  using Value = AbstractValue;
+  using TransferT = Transfer;
+  using MeetT = Meet;
+  using Info = AbstractInfo;
+};
+
+
+// A tuple of component values supporting the constructors the dataflow
+// analysis uses. Each constructor is forwarded to every component.
+template <typename... Values>
+struct ProductValue {
+  template <size_t I>
+  using Component = typename std::tuple_element<I, std::tuple<Values...>>::type;
+
+private:
+  using Predicate = llvm::CmpInst::Predicate;
+  using Indices = std::index_sequence_for<Values...>;
+
+  template <size_t I>
+  static llvm::Constant*
+  componentOf(llvm::Constant* c, std::integral_constant<size_t, I>) {
+    return c;
+  }
+
+  template <size_t I>
+  static const Component<I>&
+  componentOf(const ProductValue& other, std::integral_constant<size_t, I>) {
+    return std::get<I>(other.values);
+  }
+
+  template <typename Source, size_t... I>
+  ProductValue(std::index_sequence<I...>, const Source& source, Predicate pred,
+               const ProductValue* prevState)
+    : values(Component<I>(componentOf(source,
+                                      std::integral_constant<size_t, I>{}),
+                          pred,
+                          prevState ? &std::get<I>(prevState->values)
+                                    : nullptr)...) {}
+
+  template <size_t... I>
+  void
+  makeTop(std::index_sequence<I...>) {
+    using expand = int[];
+    (void)expand{0, (std::get<I>(values).makeTop(), 0)...};
+  }
+
+public:
+  std::tuple<Values...> values;
+
+  ProductValue() = default;
+
+  ProductValue(const ProductValue& other) = default;
+
+  ProductValue&
+  operator=(const ProductValue& other) = default;
+
+  explicit ProductValue(std::tuple<Values...> values) : values(values) {}
+
+  ProductValue(llvm::Constant* value,
+               Predicate pred = llvm::CmpInst::ICMP_EQ,
+               const ProductValue* prevState = nullptr)
+    : ProductValue(Indices{}, value, pred, prevState) {}
+
+  ProductValue(const ProductValue& other,
+               Predicate pred,
+               const ProductValue* prevState = nullptr)
+    : ProductValue(Indices{}, other, pred, prevState) {}
+
+  template <size_t I>
+  Component<I>&
+  get() {
+    return std::get<I>(values);
+  }
+
+  template <size_t I>
+  const Component<I>&
+  get() const {
+    return std::get<I>(values);
+  }
+
+  bool
+  operator==(const ProductValue& other) const {
+    return values == other.values;
+  }
+
+  void
+  makeTop() {
+    makeTop(Indices{});
+  }
+};
+
+
+// Component I of the values in a state of ProductValues, with the
+// operations of AbstractState that transfers use. Nothing is copied: lookups
+// and updates go to the tuples in the shared state.
+template <typename ProductValue, size_t I>
+class ComponentState {
+  using Shared = AbstractState<ProductValue>;
+
+public:
+  using Component = typename ProductValue::template Component<I>;
+
+  // what iterators point to, like the pairs of an AbstractState
+  struct Entry {
+    llvm::Value* first;
+    Component& second;
+  };
+
+  class iterator {
+    typename Shared::iterator at;
+    optional<Entry> entry;
+
+  public:
+    iterator(typename Shared::iterator at, typename Shared::iterator end)
+      : at(at) {
+      if (end != at) {
+        entry.emplace(Entry{at->first, at->second.template get<I>()});
+      }
+    }
+
+    Entry&
+    operator*() {
+      return *entry;
+    }
+
+    Entry*
+    operator->() {
+      return &*entry;
+    }
+
+    bool
+    operator==(const iterator& other) const {
+      return at == other.at;
+    }
+
+    bool
+    operator!=(const iterator& other) const {
+      return at != other.at;
+    }
+  };
+
+  explicit ComponentState(Shared& state) : state(state) {}
+
+  iterator
+  find(llvm::Value* v) {
+    return iterator(state.find(v), state.end());
+  }
+
+  iterator
+  end() {
+    return iterator(state.end(), state.end());
+  }
+
+  size_t
+  count(llvm::Value* v) const {
+    return state.count(v);
+  }
+
+  Component&
+  operator[](llvm::Value* v) {
+    return state[v].template get<I>();
+  }
+
+  // Enters v with this component's value unless it is present already, in
+  // which case nothing changes, as with AbstractState.
+  std::pair<iterator, bool>
+  insert(const std::pair<llvm::Value*, Component>& entry) {
+    auto inserted = state.insert({entry.first, ProductValue()});
+    if (inserted.second) {
+      inserted.first->second.template get<I>() = entry.second;
+    }
+    return {iterator(inserted.first, state.end()), inserted.second};
+  }
+
+private:
+  Shared& state;
+};
+
+
+// The default reduction keeps the domains independent.
+struct NoReduction {
+  template <typename AbstractValue>
+  void
+  operator()(llvm::Instruction& i, AbstractState<AbstractValue>& state) {}
+};
+
+
+template <typename Reduce, typename... Domains>
+struct ReducedProduct {
+  using Value = ProductValue<typename Domains::Value...>;
+  using State = AbstractState<Value>;
+
+private:
+  using Indices = std::index_sequence_for<Domains...>;
+
+  template <size_t I>
+  using DomainAt = typename std::tuple_element<I, std::tuple<Domains...>>::type;
+
+public:
+  struct Info {
+  private:
+    template <size_t... I>
+    static Value
+    emptyKey(std::index_sequence<I...>) {
+      return Value(std::make_tuple(DomainAt<I>::Info::getEmptyKey()...));
+    }
+
+    template <size_t... I>
+    static Value
+    tombstoneKey(std::index_sequence<I...>) {
+      return Value(std::make_tuple(DomainAt<I>::Info::getTombstoneKey()...));
+    }
+
+    template <size_t... I>
+    static unsigned
+    hashValue(const Value& v, std::index_sequence<I...>) {
+      unsigned hashes[] = {
+        DomainAt<I>::Info::getHashValue(std::get<I>(v.values))...};
+      unsigned total = 0;
+      for (size_t i = 0; i < sizeof...(I); i++) {
+        total = (total + (i+1) * hashes[i]) % massivePrime;
+      }
+      return total;
+    }
+
+    template <size_t... I>
+    static bool
+    equal(const Value& lhs, const Value& rhs, std::index_sequence<I...>) {
+      bool equalities[] = {
+        DomainAt<I>::Info::isEqual(std::get<I>(lhs.values),
+                                   std::get<I>(rhs.values))...};
+      return std::all_of(std::begin(equalities), std::end(equalities),
+                         [](bool eq) { return eq; });
+    }
+
+  public:
+    static inline Value getEmptyKey() { return emptyKey(Indices{}); }
+    static inline Value getTombstoneKey() { return tombstoneKey(Indices{}); }
+    static unsigned getHashValue(const Value& v) {
+      return hashValue(v, Indices{});
+    }
+    static bool isEqual(const Value& lhs, const Value& rhs) {
+      return equal(lhs, rhs, Indices{});
+    }
+  };
+
+
+  // Each component meets in place within the tuples, through meetInto, so
+  // domains that implement it directly keep their savings.
+  class Meet : public analysis::Meet<Value, Meet> {
+    mutable std::tuple<typename Domains::MeetT...> meets;
+
+    template <size_t... I>
+    bool
+    meetInto(Value& dst, const Value& src, std::index_sequence<I...>) const {
+      bool changed[] = {
+        std::get<I>(meets).meetInto(dst.template get<I>(),
+                                    src.template get<I>())...};
+      return std::any_of(std::begin(changed), std::end(changed),
+                         [](bool c) { return c; });
+    }
+
+  public:
+    bool
+    meetInto(Value& dst, const Value& src) {
+      return meetInto(dst, src, Indices{});
+    }
+
+    Value
+    meetPair(const Value& v1, const Value& v2) const {
+      Value met = v1;
+      meetInto(met, v2, Indices{});
+      return met;
+    }
+  };
+
+
+  // Component transfers run in turn on the instruction, each through a
+  // ComponentState of the shared state, followed by the reduction.
+  class Transfer {
+    std::tuple<typename Domains::TransferT...> transfers;
+    Reduce reduce;
+
+    template <size_t I>
+    void
+    applyComponent(llvm::Instruction& i,
+                   State& state,
+                   std::vector<unsigned>& context) {
+      ComponentState<Value, I> component(state);
+      std::get<I>(transfers)(i, component, context);
+    }
+
+    template <size_t... I>
+    void
+    applyAll(llvm::Instruction& i,
+             State& state,
+             std::vector<unsigned>& context,
+             std::index_sequence<I...>) {
+      using expand = int[];
+      (void)expand{0, (applyComponent<I>(i, state, context), 0)...};
+    }
+
+  public:
+    explicit Transfer(typename Domains::TransferT... transfers,
+                      Reduce reduce = Reduce())
+      : transfers(transfers...), reduce(reduce) {}
+
+    void
+    operator()(llvm::Instruction& i,
+               State& state,
+               std::vector<unsigned>& context) {
+      applyAll(i, state, context, Indices{});
+      reduce(i, state);
+    }
+  };
+};
+
+
+template <typename... Domains>
+using Product = ReducedProduct<NoReduction, Domains...>;
+
+
+} // end namespace
+
+
+#endif
@@ -0,0 +1,201 @@
+
+#ifndef RANGE_INDEX_H
+#define RANGE_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// On disk layout of the range fact index written by overflower -range-index.
+// It needs nothing but this header to read, so editors and scripts can map
+// the file and answer "what is the range of X at Y" without LLVM.
+//
+// The file is a header, a table of functions sorted by hash, then four
+// columns with one entry per fact:
+//
+//   instructions  uint32  index of the instruction within its function
+//   values        uint32  number of the value within its function
+//   lowers        int64   lower bound of the value
+//   uppers        int64   upper bound of the value
+//
+// A fact is the range of a value in the converged state after an
+// instruction, recorded for the instruction itself and for each of its
+// operands. Facts of a function are contiguous and sorted by instruction,
+// then value. Instructions are indexed in function order; values number the
+// function's arguments first, then its instructions in the same order.
+// Unbounded ends are INT64_MIN and INT64_MAX. Functions are keyed by the
+// 64 bit FNV-1a hash of their name. Integers are in host byte order.
+namespace rangeindex {
+
+
+const char magic[8] = {'O', 'V', 'F', 'R', 'I', 'D', 'X', '\0'};
+const uint32_t version = 1;
+
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t functionCount;
+  uint64_t factCount;
+  // byte offsets from the start of the file, each 8 byte aligned
+  uint64_t functions;
+  uint64_t instructions;
+  uint64_t values;
+  uint64_t lowers;
+  uint64_t uppers;
+};
+
+
+struct Function {
+  uint64_t hash;
+  uint64_t firstFact;
+  uint64_t factCount;
+};
+
+
+inline uint64_t
+hashName(const char* name, size_t length) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<unsigned char>(name[i]);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+
+class Reader {
+  const char* data = nullptr;
+  size_t size = 0;
+  const Header* header = nullptr;
+  const Function* functions = nullptr;
+  const uint32_t* instructions = nullptr;
+  const uint32_t* values = nullptr;
+  const int64_t* lowers = nullptr;
+  const int64_t* uppers = nullptr;
+
+  bool
+  fits(uint64_t offset, uint64_t count, size_t width) const {
+    return offset % 8 == 0 && offset <= size
+      && count <= (size - offset) / width;
+  }
+
+  void
+  close() {
+    if (data) {
+      munmap(const_cast<char*>(data), size);
+    }
+    data = nullptr;
+    header = nullptr;
+  }
+
+public:
+  Reader() = default;
+
+  Reader(const Reader&) = delete;
+
+  Reader&
+  operator=(const Reader&) = delete;
+
+  ~Reader() {
+    close();
+  }
+
+  // Maps the index at path, returning false if it is missing or malformed.
+  bool
+  open(const char* path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+      ::close(fd);
+      return false;
+    }
+    size = st.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (MAP_FAILED == mapped) {
+      return false;
+    }
+    data = static_cast<const char*>(mapped);
+    header = reinterpret_cast<const Header*>(data);
+
+    if (memcmp(header->magic, magic, sizeof(magic)) != 0
+        || header->version != version
+        || !fits(header->functions, header->functionCount, sizeof(Function))
+        || !fits(header->instructions, header->factCount, sizeof(uint32_t))
+        || !fits(header->values, header->factCount, sizeof(uint32_t))
+        || !fits(header->lowers, header->factCount, sizeof(int64_t))
+        || !fits(header->uppers, header->factCount, sizeof(int64_t))) {
+      close();
+      return false;
+    }
+    functions = reinterpret_cast<const Function*>(data + header->functions);
+    instructions =
+      reinterpret_cast<const uint32_t*>(data + header->instructions);
+    values = reinterpret_cast<const uint32_t*>(data + header->values);
+    lowers = reinterpret_cast<const int64_t*>(data + header->lowers);
+    uppers = reinterpret_cast<const int64_t*>(data + header->uppers);
+    return true;
+  }
+
+  // The range of value number value in the state after instruction number
+  // instruction of the function with the given hash, if one was recorded.
+  bool
+  lookup(uint64_t functionHash, uint32_t instruction, uint32_t value,
+         int64_t& lower, int64_t& upper) const {
+    if (nullptr == header) {
+      return false;
+    }
+    const Function* end = functions + header->functionCount;
+    const Function* f = std::lower_bound(functions, end, functionHash,
+      [] (const Function& f, uint64_t hash) { return f.hash < hash; });
+    if (end == f || f->hash != functionHash
+        || f->firstFact > header->factCount
+        || f->factCount > header->factCount - f->firstFact) {
+      return false;
+    }
+
+    uint64_t low = f->firstFact;
+    uint64_t high = f->firstFact + f->factCount;
+    while (low < high) {
+      uint64_t mid = low + (high - low) / 2;
+      if (instructions[mid] < instruction
+          || (instructions[mid] == instruction && values[mid] < value)) {
+        low = mid + 1;
+      }
+      else {
+        high = mid;
+      }
+    }
+    if (low == f->firstFact + f->factCount
+        || instructions[low] != instruction || values[low] != value) {
+      return false;
+    }
+    lower = lowers[low];
+    upper = uppers[low];
+    return true;
+  }
+
+  bool
+  lookup(const char* functionName, uint32_t instruction, uint32_t value,
+         int64_t& lower, int64_t& upper) const {
+    return lookup(hashName(functionName, strlen(functionName)),
+                  instruction, value, lower, upper);
+  }
+};
+
+
+} // end namespace
+
+
+#endif
@@ -0,0 +1,307 @@
+
+#ifndef SUMMARY_STORE_H
+#define SUMMARY_STORE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "DataflowAnalysis.h"
+
+
+namespace analysis {
+
+
+struct SummaryStoreCounters {
+  unsigned long hits = 0;      // lookups answered, from memory or the spill
+  unsigned long misses = 0;    // lookups that left the summary to compute
+  unsigned long evictions = 0; // summaries dropped or spilled to fit
+  unsigned long spills = 0;    // evictions written to the spill file
+  unsigned long reloads = 0;   // hits restored from the spill file
+  size_t bytes = 0;            // approximate bytes of the summaries held
+  size_t peakBytes = 0;
+};
+
+
+// Keeps the callee summaries of a Summary within a budget of bytes. Entries
+// are evicted by GreedyDual-Size: each has a priority of the inflation plus
+// its recomputation cost, in block visits, per byte, refreshed on every hit.
+// The entry with the lowest priority goes first and raises the inflation to
+// its priority, so entries that are cheap to recompute, large or long unused
+// go before expensive ones that are still called for.
+//
+// With a spill file, evicted entries are appended to it rather than dropped,
+// and restored when called for again. Only a hash of the arguments and an
+// offset stay in memory per spilled entry. The file is scratch space for one
+// run that only grows, as restored entries leave their records behind, and
+// values are written with the encoder given, which may refer to memory of
+// the process, e.g. interned ids or types.
+//
+// Sizes count the summary buckets and argument vectors, as
+// approximateSummaryBytes does, along with this store's bookkeeping for each
+// entry. Summaries the store has not been handed, i.e. those of top level
+// analyses and calls still in progress, are neither counted nor evicted.
+template <typename AbstractValue, typename AbstractInfo>
+class BoundedSummaryStore : public SummaryStore<AbstractValue> {
+public:
+  using Args = std::vector<AbstractValue>;
+  // appends a value to the buffer
+  using Encode = std::function<void(const AbstractValue&, std::string&)>;
+  // reads a value at the cursor and advances it past the value
+  using Decode = std::function<AbstractValue(const char*&)>;
+
+  BoundedSummaryStore(Summary<AbstractValue, AbstractInfo>& summaries,
+                      size_t capacity)
+    : summaries(summaries), capacity(capacity) {}
+
+  // Spill evicted entries to path, replacing its contents. Returns false if
+  // it cannot be opened, in which case entries are dropped.
+  bool
+  enableSpill(const std::string& path, Encode encoder, Decode decoder) {
+    spill.open(path, std::ios::in | std::ios::out | std::ios::binary
+                     | std::ios::trunc);
+    encode = encoder;
+    decode = decoder;
+    spillEnd = 0;
+    return spill.is_open();
+  }
+
+  bool
+  lookup(llvm::Function* f, const Args& args, bool count) override {
+    auto& known = summaries[f];
+    if (known.end() != known.find(args)) {
+      touch(f, args);
+      if (count) {
+        counters.hits++;
+      }
+      return true;
+    }
+    if (reload(f, args)) {
+      if (count) {
+        counters.hits++;
+      }
+      return true;
+    }
+    if (count) {
+      counters.misses++;
+    }
+    return false;
+  }
+
+  void
+  admit(llvm::Function* f, const Args& args, unsigned long cost) override {
+    auto& tracked = entries[f];
+    auto found = tracked.find(args);
+    if (tracked.end() != found) {
+      order.erase({found->second.priority, found->second.id});
+      found->second.cost = cost;
+    }
+    else {
+      Entry entry{nextId++, cost, entryBytes(args), 0};
+      found = tracked.insert({args, entry}).first;
+      owners.insert({entry.id, {f, args}});
+      counters.bytes += entry.bytes;
+    }
+    found->second.priority = priorityOf(found->second);
+    order.insert({found->second.priority, found->second.id});
+    evict(found->second.id);
+    counters.peakBytes = std::max(counters.peakBytes, counters.bytes);
+  }
+
+  // Forget every entry, once the summaries were cleared. Counters other
+  // than the bytes held keep accumulating.
+  void
+  clear() {
+    entries.clear();
+    order.clear();
+    owners.clear();
+    spilled.clear();
+    inflation = 0;
+    counters.bytes = 0;
+    if (spill.is_open()) {
+      spillEnd = 0;
+    }
+  }
+
+  const SummaryStoreCounters&
+  getCounters() const {
+    return counters;
+  }
+
+private:
+  struct Entry {
+    uint64_t id;
+    unsigned long cost;
+    size_t bytes;
+    double priority;
+  };
+
+  using Entries = llvm::DenseMap<Args, Entry, ArgInfo<AbstractValue, AbstractInfo>>;
+
+  Summary<AbstractValue, AbstractInfo>& summaries;
+  size_t capacity;
+  SummaryStoreCounters counters;
+
+  llvm::DenseMap<llvm::Function*, Entries> entries;
+  // eviction order, lowest priority first and oldest first among equals
+  std::set<std::pair<double, uint64_t>> order;
+  std::unordered_map<uint64_t, std::pair<llvm::Function*, Args>> owners;
+  uint64_t nextId = 0;
+  double inflation = 0;
+
+  std::fstream spill;
+  Encode encode;
+  Decode decode;
+  uint64_t spillEnd = 0;
+  // offsets of spilled entries by the hash of their arguments
+  llvm::DenseMap<llvm::Function*, std::unordered_multimap<unsigned, uint64_t>>
+    spilled;
+
+  static size_t
+  entryBytes(const Args& args) {
+    using Bucket = typename Arg2Ret<AbstractValue, AbstractInfo>::value_type;
+    size_t arguments = args.size() * sizeof(AbstractValue);
+    // the summary, then the entry and the owner, which copy the arguments,
+    // and the node in the eviction order
+    return sizeof(Bucket) + arguments
+      + sizeof(typename Entries::value_type) + arguments
+      + sizeof(std::pair<llvm::Function*, Args>) + arguments
+      + 4 * sizeof(void*);
+  }
+
+  double
+  priorityOf(const Entry& entry) const {
+    return inflation + double(entry.cost + 1) / entry.bytes;
+  }
+
+  void
+  touch(llvm::Function* f, const Args& args) {
+    auto tracked = entries.find(f);
+    if (entries.end() == tracked) {
+      return;
+    }
+    auto found = tracked->second.find(args);
+    if (tracked->second.end() == found) {
+      return;
+    }
+    order.erase({found->second.priority, found->second.id});
+    found->second.priority = priorityOf(found->second);
+    order.insert({found->second.priority, found->second.id});
+  }
+
+  // evict until the entries fit, except for the one given
+  void
+  evict(uint64_t keep) {
+    auto victim = order.begin();
+    while (counters.bytes > capacity && order.end() != victim) {
+      if (victim->second == keep) {
+        ++victim;
+        continue;
+      }
+      inflation = victim->first;
+      auto owner = owners.find(victim->second);
+      llvm::Function* f = owner->second.first;
+      Args& args = owner->second.second;
+      auto tracked = entries[f].find(args);
+
+      auto& known = summaries[f];
+      auto summary = known.find(args);
+      if (known.end() != summary) {
+        if (spill.is_open()) {
+          write(f, args, summary->second, tracked->second.cost);
+        }
+        known.erase(summary);
+      }
+      counters.bytes -= tracked->second.bytes;
+      counters.evictions++;
+      entries[f].erase(tracked);
+      owners.erase(owner);
+      victim = order.erase(victim);
+    }
+  }
+
+  // Records are the byte count of the rest, the cost, the argument count,
+  // the arguments and the summary.
+  void
+  write(llvm::Function* f, const Args& args, const AbstractValue& value,
+        unsigned long cost) {
+    std::string record(sizeof(uint64_t) + sizeof(uint32_t), '\0');
+    uint64_t cost64 = cost;
+    uint32_t count = args.size();
+    memcpy(&record[0], &cost64, sizeof(cost64));
+    memcpy(&record[sizeof(cost64)], &count, sizeof(count));
+    for (auto& arg : args) {
+      encode(arg, record);
+    }
+    encode(value, record);
+
+    uint32_t length = record.size();
+    spill.seekp(spillEnd);
+    spill.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    spill.write(record.data(), record.size());
+    if (!spill) {
+      // keep running without spilling rather than lose track of the file
+      spill.close();
+      return;
+    }
+    spilled[f].insert({ArgInfo<AbstractValue, AbstractInfo>::getHashValue(args),
+                       spillEnd});
+    spillEnd += sizeof(length) + record.size();
+    counters.spills++;
+  }
+
+  bool
+  reload(llvm::Function* f, const Args& args) {
+    auto fileEntries = spilled.find(f);
+    if (spilled.end() == fileEntries || !spill.is_open()) {
+      return false;
+    }
+    auto candidates = fileEntries->second.equal_range(
+      ArgInfo<AbstractValue, AbstractInfo>::getHashValue(args));
+    for (auto candidate = candidates.first; candidate != candidates.second;
+         ++candidate) {
+      uint32_t length = 0;
+      spill.seekg(candidate->second);
+      spill.read(reinterpret_cast<char*>(&length), sizeof(length));
+      std::string record(length, '\0');
+      spill.read(&record[0], length);
+      if (!spill) {
+        spill.clear();
+        return false;
+      }
+
+      uint64_t cost = 0;
+      uint32_t count = 0;
+      memcpy(&cost, &record[0], sizeof(cost));
+      memcpy(&count, &record[sizeof(cost)], sizeof(count));
+      const char* cursor = record.data() + sizeof(cost) + sizeof(count);
+      Args stored;
+      for (uint32_t a = 0; a < count; a++) {
+        stored.push_back(decode(cursor));
+      }
+      if (stored.size() != args.size()
+          || !ArgInfo<AbstractValue, AbstractInfo>::isEqual(stored, args)) {
+        continue;
+      }
+
+      summaries[f][args] = decode(cursor);
+      fileEntries->second.erase(candidate);
+      counters.reloads++;
+      admit(f, args, cost);
+      return true;
+    }
+    return false;
+  }
+};
+
+
+} // end namespace
+
+
+#endif
@@ -0,0 +1,31 @@
+//
+// In-process IR preprocessing run before the analysis.
+//
+
+#ifndef OVERFLOWER_CANONICALIZE_H
+#define OVERFLOWER_CANONICALIZE_H
+
+#include "llvm/IR/Module.h"
+
+#include <string>
+#include <vector>
+
+
+// instruction and block counts of the module around canonicalization
+struct CanonicalizeStats {
+	size_t instsBefore = 0;
+	size_t instsAfter = 0;
+	size_t blocksBefore = 0;
+	size_t blocksAfter = 0;
+};
+
+
+// Run the named passes over the module in order, as `opt -<name>` would,
+// e.g. {"mem2reg", "simplifycfg", "instcombine", "ipsccp"}. Returns false
+// without modifying the module if any of the names is not a known pass.
+bool
+canonicalize(llvm::Module& m, const std::vector<std::string>& passes,
+	CanonicalizeStats& stats);
+
+
+#endif //OVERFLOWER_CANONICALIZE_H
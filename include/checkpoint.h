@@ -0,0 +1,119 @@
+//
+// Checkpoints of an OverflowerSession, so a long run that is killed can
+// resume where it left off rather than start over.
+//
+
+#ifndef OVERFLOWER_CHECKPOINT_H
+#define OVERFLOWER_CHECKPOINT_H
+
+#include "overflower.h"
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// Appends what a session completes to a file as the analysis goes: the
+// summaries computed, the reports found, which geps were proven safe, which
+// top level functions were analyzed and the fixpoint counters. Only what is
+// new since the last checkpoint is written, one record per line, so a
+// checkpoint costs a scan of the summaries and a single append. Records
+// are facts that hold on their own, so a file cut short by a kill simply
+// resumes from fewer of them; a last line without its newline is ignored
+// and cut off on resume.
+//
+// Records refer to functions by name and to instructions by their index in
+// the function, so a checkpoint is only valid for the module it was written
+// for, which its first line identifies. Types are written once as text and
+// looked up among the types of the module on resume.
+//
+// Checkpoints are written between top level functions, at most once per
+// interval, and once more when the session finished the module.
+class SessionCheckpoint {
+	using Args = std::vector<BoundValue>;
+	using ArgSet = llvm::DenseSet<Args, analysis::ArgInfo<BoundValue, BoundInfo> >;
+
+	std::ofstream out;
+	std::chrono::seconds interval;
+	std::chrono::steady_clock::time_point lastWrite;
+
+	// top level functions analyzed in the current pass
+	llvm::DenseSet<llvm::Function*> finished;
+	std::vector<llvm::Function*> pendingFinished;
+	// set once the adaptive pass escalated, see OverflowerSession
+	bool escalated = false;
+	llvm::DenseSet<llvm::Function*> escalatedSet;
+
+	// what was already written, or replayed on resume
+	llvm::DenseMap<llvm::Type*, unsigned> typeIds;
+	llvm::DenseMap<llvm::Function*, ArgSet> writtenSummaries;
+	// reports along with whether they were written as logged
+	llvm::DenseMap<ErrReport*, bool> writtenReports;
+	llvm::DenseMap<llvm::Instruction*, bool> writtenSafe;
+
+	// instruction numbers of the functions records referred to
+	llvm::DenseMap<llvm::Function*, llvm::DenseMap<llvm::Instruction*, unsigned> > numbers;
+
+	unsigned
+	numberOf(llvm::Instruction* i);
+
+	void
+	appendValue(std::string& record, const BoundValue& value);
+
+	void
+	appendType(std::string& record, llvm::Type* type);
+
+	// replay records into session, valid is the length of the complete ones
+	bool
+	replay(std::istream& in, llvm::Module& m, OverflowerSession& session,
+		uint64_t& valid, std::string& error);
+
+public:
+	explicit SessionCheckpoint(unsigned intervalSeconds = 60)
+		: interval(intervalSeconds) {}
+
+	// start a new checkpoint of m at path, replacing its contents
+	bool
+	create(const std::string& path, llvm::Module& m);
+
+	// replay the checkpoint at path into a session that has not analyzed
+	// anything yet, then keep appending to it; false with a reason in error
+	// if it cannot be read or was written for another module
+	bool
+	resume(const std::string& path, llvm::Module& m, OverflowerSession& session,
+		std::string& error);
+
+	// only replay the checkpoint at path into session, leaving the file as
+	// it is, e.g. to collect the results of another process
+	bool
+	read(const std::string& path, llvm::Module& m, OverflowerSession& session,
+		std::string& error);
+
+	bool
+	isFinished(llvm::Function* f) const {
+		return finished.count(f);
+	}
+
+	// the functions the adaptive pass escalated to, if it got that far
+	const llvm::DenseSet<llvm::Function*>*
+	getEscalated() const {
+		return escalated ? &escalatedSet : nullptr;
+	}
+
+	// f was analyzed at top level; checkpoint if the interval has elapsed
+	void
+	functionDone(OverflowerSession& session, llvm::Function& f);
+
+	// the adaptive pass cleared the session to reanalyze these functions
+	void
+	escalate(OverflowerSession& session,
+		const llvm::DenseSet<llvm::Function*>& functions);
+
+	// append everything that was not written yet
+	void
+	write(OverflowerSession& session);
+};
+
+
+#endif //OVERFLOWER_CHECKPOINT_H
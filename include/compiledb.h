@@ -0,0 +1,94 @@
+//
+// Compilation databases and the cache of analysis ready bitcode built from
+// them, for overflower-scan.
+//
+
+#ifndef OVERFLOWER_COMPILEDB_H
+#define OVERFLOWER_COMPILEDB_H
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// one entry of a compile_commands.json
+struct CompileCommand {
+	std::string directory;
+	std::string file;
+	// the compiler followed by its arguments, from either "arguments" or
+	// "command" split as a shell would
+	std::vector<std::string> arguments;
+};
+
+
+// Read the entries of the JSON compilation database at path, in order.
+// Returns false with a reason in error if it cannot be read or parsed.
+bool
+readCompilationDatabase(const std::string& path,
+	std::vector<CompileCommand>& commands, std::string& error);
+
+
+// A directory of canonicalized bitcode for the commands of a compilation
+// database, addressed by the content of what they compile.
+//
+// A translation unit is compiled with clang to bitcode, canonicalized in
+// process with the given passes and stored under a digest of the command,
+// the compiler, the passes, and the contents of the source and of every
+// header the compiler read for it, as its dependency output lists them.
+// Those files are noted in a manifest per command, so finding the bitcode of
+// an unchanged unit only takes hashing them again, without running clang.
+// Editing a file, changing a flag or switching compilers gives a new digest,
+// while the bitcode of earlier contents stays in the cache, e.g. for a
+// branch that is checked out again. A unit whose files change while clang
+// compiles it is not cached. This is weaker than a digest of the
+// preprocessed source: a new header that shadows a listed one on the include
+// path goes unnoticed until the unit is compiled for another reason.
+//
+// Entries are written to a temporary file and renamed into place, so a
+// cache can be shared by concurrent threads and processes, and an entry is
+// either complete or absent.
+class BitcodeCache {
+	std::string directory;
+	std::string clang;
+	std::vector<std::string> passes;
+	// digest of the compiler and passes, common to every entry
+	std::string toolchain;
+
+	std::string
+	commandDigest(const CompileCommand& command) const;
+
+	bool
+	contentDigest(const std::string& commandKey,
+		const std::vector<std::string>& files, std::string& digest) const;
+
+	// compile command, and cache the result unless a file it depends on,
+	// including those previous compiles depended on, changed meanwhile
+	std::unique_ptr<llvm::Module>
+	compile(const CompileCommand& command, const std::string& commandKey,
+		const std::vector<std::string>& previous, llvm::LLVMContext& context,
+		std::string& error);
+
+public:
+	// cache entries in directory, compiling with the clang executable at
+	// clang and canonicalizing with passes, see canonicalize()
+	BitcodeCache(std::string directory, std::string clang,
+		std::vector<std::string> passes);
+
+	// create the directory if needed; false with a reason in error if the
+	// cache cannot be used
+	bool
+	open(std::string& error);
+
+	// The canonicalized module of command in context, from the cache if its
+	// contents are unchanged and compiled otherwise, or nullptr with the
+	// reason and the compiler's output in error. cached tells which.
+	std::unique_ptr<llvm::Module>
+	load(const CompileCommand& command, llvm::LLVMContext& context,
+		bool& cached, std::string& error);
+};
+
+
+#endif //OVERFLOWER_COMPILEDB_H
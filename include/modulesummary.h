@@ -0,0 +1,103 @@
+//
+// Summaries of separately analyzed modules and the thin global step that
+// links them, so that a program can be analyzed one module at a time.
+//
+
+#ifndef OVERFLOWER_MODULESUMMARY_H
+#define OVERFLOWER_MODULESUMMARY_H
+
+#include "overflower.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// The calls of one module into functions other modules define.
+//
+// An analysis records the argument ranges of every call to a function the
+// module only declares, and writeSummary writes them along with the
+// summaries of the functions the module exports, i.e. their return values as
+// functions of argument ranges. The link step then reads only the summary
+// files of all modules and writes one file of imports per module, which the
+// next analysis reads with readImports: the summaries of other modules to
+// use at its calls, and the exported functions to recheck in the contexts
+// other modules call them in, as a whole program analysis would have.
+//
+// Imports come from the summaries of the previous analyses, so each round of
+// analyzing and linking carries return values across one more module
+// boundary. Reports only depend on the imports of their own module, so a
+// module whose imports did not change need not be analyzed again.
+class ModuleLinkage : public analysis::ExternalCalls<BoundValue> {
+	using Args = std::vector<BoundValue>;
+	using ArgMap = llvm::DenseMap<Args, BoundValue,
+		analysis::ArgInfo<BoundValue, BoundInfo> >;
+
+	struct Recheck {
+		llvm::Function* f;
+		std::vector<unsigned> context;
+		Args args;
+	};
+
+	// calls to declared functions as summary records, in the order first
+	// made, each with the arguments it was last made with in its context,
+	// which are those of the fixpoint of its caller
+	std::vector<std::string> calls;
+	std::map<std::pair<llvm::CallInst*, std::vector<unsigned> >, size_t> called;
+	// summaries of functions defined in other modules
+	llvm::DenseMap<llvm::Function*, ArgMap> imported;
+	std::vector<Recheck> rechecks;
+
+public:
+	bool
+	resolve(llvm::CallInst& call, const Args& args,
+		const std::vector<unsigned>& context, BoundValue& result) override;
+
+	// write the summary of m once session analyzed it with these calls; false
+	// if path cannot be written
+	bool
+	writeSummary(const std::string& path, llvm::Module& m,
+		OverflowerSession& session) const;
+
+	// read the imports the link step wrote for m into values of session;
+	// false with a reason in error if they cannot be read or were written for
+	// another module
+	bool
+	readImports(const std::string& path, llvm::Module& m,
+		OverflowerSession& session, std::string& error);
+
+	// analyze the exported functions of the module in the contexts other
+	// modules call them in, once session analyzed the module; a function
+	// session already summarized for the arguments of a context is skipped
+	void
+	recheck(OverflowerSession& session) const;
+};
+
+
+struct LinkStats {
+	unsigned modules = 0;
+	unsigned exports = 0;
+	// calls to declared functions, and those into the linked modules
+	unsigned calls = 0;
+	unsigned linked = 0;
+	// linked calls whose callee has a summary for their arguments
+	unsigned resolved = 0;
+	unsigned rechecks = 0;
+	// functions exported by more than one module, which are linked to the
+	// first
+	std::vector<std::string> duplicates;
+};
+
+
+// The thin global step: read the module summaries at paths and write the
+// imports of each next to it, as <path>.imports. A function exported by
+// several modules is taken from the first and listed in the duplicates of
+// stats. Returns false with a reason in
+// error if a summary cannot be read or its imports cannot be written.
+bool
+linkModuleSummaries(const std::vector<std::string>& paths, LinkStats& stats,
+	std::string& error);
+
+
+#endif //OVERFLOWER_MODULESUMMARY_H
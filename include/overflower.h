@@ -15,13 +15,18 @@
 
 #include "llvm/ADT/APSInt.h"
 #include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Support/MathExtras.h"
 
 #include "DataflowAnalysis.h"
+#include "SummaryStore.h"
 
 #include <utility>
 #include <fstream>
 #include <iostream>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #ifndef OVERFLOWER_OVERFLOWER_H
 #define OVERFLOWER_OVERFLOWER_H
@@ -38,26 +43,75 @@ const int64_t NEGINF 	= -INF;
 using BOUND = optional<std::pair<int64_t,int64_t> >;
 
 
+// Everything a BoundValue knows about a variable. The range and type are
+// interned, so every distinct pair is stored once and values refer to it by
+// id. The entropy is kept beside the id instead: comparisons draw it at
+// random, so hardly two values share it. See BoundFacts.
+struct BoundFact {
+	BOUND range; // undefined by default
+	// use range_entropy for widening, and updated during meet and transfer
+	float range_entropy = 0.0;
+	// retain type in order to better approximate error bounds
+	Type* boundType = nullptr;
+
+	// exact equality, unlike BoundValue which only compares ranges
+	bool
+	operator == (const BoundFact& other) const {
+		return range == other.range && range_entropy == other.range_entropy &&
+			boundType == other.boundType;
+	}
+};
+
+
+struct BoundFactHash {
+	size_t
+	operator () (const BoundFact& fact) const;
+};
+
+
+class BoundFacts;
+
+
 struct BoundValue {
 private:
+	friend class BoundFacts;
+
+	// id of the interned range and type, 0 is the undefined value
+	unsigned id = 0;
+	float range_entropy = 0.0;
+
+	// the interned range and type, without the entropy
+	const BoundFact&
+	interned() const;
+
+	void
+	assign(const BoundFact& fact);
+
 	std::pair<float, BOUND> predicateBound(int64_t value,
 		llvm::CmpInst::Predicate pred,
 		const BoundValue* prevState) const;
 public:
-	BOUND range; // undefined by default
-	// use range_entropy for widening, and updated during meet and transfer
-	float range_entropy = 0.0;
-	// retain type in order to better approximate error bounds
-	Type* boundType = nullptr;
+	// the table values are interned in, which analyses carry over to the
+	// threads they iterate regions on
+	using Context = BoundFacts;
 
 	BoundValue() {}
 
+	explicit BoundValue(const BoundFact& fact);
+
 	BoundValue(llvm::Constant* value,
 		llvm::CmpInst::Predicate pred = llvm::CmpInst::ICMP_EQ,
 		const BoundValue* prevState = nullptr);
 
+	// copies keep the range and entropy as they are, only the predicated
+	// constructor below re-derives and widens them
+	BoundValue(const BoundValue& other) = default;
+
+	BoundValue&
+	operator = (const BoundValue& other) = default;
+
 	BoundValue(const BoundValue& other,
-		llvm::CmpInst::Predicate pred = llvm::CmpInst::ICMP_EQ,
+		llvm::CmpInst::Predicate pred,
 		const BoundValue* prevState = nullptr);
 
 	BoundValue(BOUND range, Type* boundType);
@@ -68,6 +122,29 @@ public:
 	BoundValue(const BoundValue& v1, const BoundValue& v2,
 		std::function<optional<int64_t>(int64_t,int64_t,Type*)> eval);
 
+	BoundFact
+	fact() const;
+
+	const BOUND&
+	range() const {
+		return interned().range;
+	}
+
+	float
+	entropy() const {
+		return range_entropy;
+	}
+
+	Type*
+	type() const {
+		return interned().boundType;
+	}
+
+	unsigned
+	getId() const {
+		return id;
+	}
+
 	BoundValue
 	operator | (const BoundValue& other) const;
 
@@ -79,27 +156,172 @@ public:
 
 	bool
 	isInf() const {
-		return range && NEGINF == range->first && INF == range->second;
+		const BOUND& r = range();
+		return r && NEGINF == r->first && INF == r->second;
+	}
+
+	void
+	makeTop();
+};
+
+
+// the range as reports print it, e.g. 0:16 or -inf:inf, or undef
+std::ostream&
+operator << (std::ostream& out, const BoundValue& v);
+
+
+// the operands of a meet, by their ids and the bits of their entropy
+struct MeetKey {
+	unsigned id1;
+	uint32_t entropy1;
+	unsigned id2;
+	uint32_t entropy2;
+
+	bool
+	operator == (const MeetKey& other) const {
+		return id1 == other.id1 && entropy1 == other.entropy1 &&
+			id2 == other.id2 && entropy2 == other.entropy2;
 	}
+};
+
+
+struct MeetKeyHash {
+	size_t
+	operator () (const MeetKey& key) const;
+};
+
 
+// Intern table for the ranges and types of BoundFacts along with memoized
+// meets. Meets are deterministic in their operands' facts, so a repeated join
+// is a single lookup. Facts are stored in chunks that never move, so a fact can
+// be read without the lock while regions of a function are iterated in
+// parallel.
+//
+// Every OverflowerSession owns a table, and a value only means something in
+// the table it was interned in. Values intern into and read from the table
+// made current on their thread by a Scope, which sessions open around all
+// they do; code handling the values of a session outside of it opens one on
+// the session's table itself. Facts hold types, so a table must not outlive
+// the context of the modules its session analyzes.
+//
+// Neither grows without bound: the meet memo is emptied whenever it reaches
+// maxMeets entries, and once every id is taken, ranges that are not interned
+// yet become Top, with a warning. Clearing a session empties its table.
+class BoundFacts {
+	static const unsigned chunkBits = 12;
+	static const unsigned chunkCount = 1 << 14;
+	static const size_t maxMeets = 1 << 20;
+
+	mutable std::mutex lock;
+	std::unique_ptr<BoundFact[]> chunks[chunkCount];
+	unsigned count = 0;
+	bool full = false;
+	std::unordered_map<BoundFact, unsigned, BoundFactHash> ids;
+
+	std::unordered_map<MeetKey, BoundValue, MeetKeyHash> meets;
+
+	// intern the facts of Reserved
 	void
-	makeTop() {
-		range = BOUND({NEGINF, INF});
+	initialize();
+
+public:
+	// ids of the facts every table starts with, so that values of them can
+	// be made without a table
+	enum Reserved : unsigned {
+		undefined = 0,
+		top,
+		emptyKey,
+		tombstoneKey,
+	};
+
+	// Makes a table current on this thread for the lifetime of the scope.
+	class Scope {
+		BoundFacts* previous;
+
+	public:
+		explicit Scope(BoundFacts* facts);
+
+		Scope(const Scope&) = delete;
+
+		Scope&
+		operator = (const Scope&) = delete;
+
+		~Scope();
+	};
+
+	BoundFacts();
+
+	BoundFacts(const BoundFacts&) = delete;
+
+	BoundFacts&
+	operator = (const BoundFacts&) = delete;
+
+	// the table current on this thread, if any
+	static BoundFacts*
+	current();
+
+	static BoundValue
+	reserved(Reserved id) {
+		BoundValue value;
+		value.id = id;
+		return value;
+	}
+
+	const BoundFact&
+	get(unsigned id) const {
+		return chunks[id >> chunkBits][id & ((1 << chunkBits) - 1)];
+	}
+
+	// the id of the range and type of fact, whatever its entropy
+	unsigned
+	intern(const BoundFact& fact);
+
+	// number of distinct ranges and types interned so far
+	size_t
+	size() const;
+
+	// forget every interned fact and meet, once no value of the table is
+	// left
+	void
+	clear();
+
+	// compute is called outside of the lock, since computing interns facts
+	template <typename Compute>
+	BoundValue
+	meet(const BoundValue& v1, const BoundValue& v2, const Compute& compute) {
+		MeetKey key{v1.id, FloatToBits(v1.range_entropy),
+			v2.id, FloatToBits(v2.range_entropy)};
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			auto found = meets.find(key);
+			if (meets.end() != found) {
+				return found->second;
+			}
+		}
+		BoundValue computed = compute();
+		std::lock_guard<std::mutex> guard(lock);
+		if (meets.size() >= maxMeets) {
+			meets.clear();
+		}
+		meets.insert({key, computed});
+		return computed;
 	}
 };
 
 
 struct BoundInfo {
 	static inline BoundValue getEmptyKey() {
-		return BoundValue(BOUND({NEGINF, NEGINF}), nullptr);
+		return BoundFacts::reserved(BoundFacts::emptyKey);
 	}
+	// must differ from the empty key, or erasing an entry would cut the
+	// probe chains through it; no transfer produces an inverted range
 	static inline BoundValue getTombstoneKey() {
-		return BoundValue(BOUND({NEGINF, NEGINF}), nullptr);
+		return BoundFacts::reserved(BoundFacts::tombstoneKey);
 	}
 	static unsigned getHashValue(const BoundValue& Val) {
-		if (Val.range) {
-			int64_t lower = Val.range->first;
-			int64_t upper = Val.range->second;
+		if (const BOUND& range = Val.range()) {
+			int64_t lower = range->first;
+			int64_t upper = range->second;
 			// hash by cantor pairing depending on sign
 			// with low probability of overflow...
 			unsigned A = (unsigned)(lower >= 0 ? 2 * (long)lower : -2 * (long)lower - 1);
@@ -110,9 +332,16 @@ struct BoundInfo {
 		return 0;
 	}
 	static bool isEqual(const BoundValue& lhs, const BoundValue& rhs) {
+		if (lhs.getId() == rhs.getId()) {
+			return true;
+		}
+		// keys are told apart without a table, e.g. while maps are destroyed
+		if (isKey(lhs) || isKey(rhs)) {
+			return false;
+		}
 		if (lhs.hasRange() == rhs.hasRange()) {
 			if (lhs.hasRange()) {
-				return lhs.range->first == rhs.range->first && lhs.range->second == rhs.range->second;
+				return lhs.range()->first == rhs.range()->first && lhs.range()->second == rhs.range()->second;
 			}
 			else {
 				return true;
@@ -120,44 +349,426 @@ struct BoundInfo {
 		}
 		return false;
 	}
+	static bool isKey(const BoundValue& value) {
+		return BoundFacts::emptyKey == value.getId()
+			|| BoundFacts::tombstoneKey == value.getId();
+	}
 };
 
 
 using BoundState  = analysis::AbstractState<BoundValue>;
 using BoundResult = analysis::DataflowResult<BoundValue>;
 using BoundSummary = analysis::Summary<BoundValue, BoundInfo>;
+using BoundAcceleration = analysis::LoopAcceleration<BoundValue>;
 
 
 class BoundMeet : public analysis::Meet<BoundValue, BoundMeet> {
 public:
 	BoundValue
-	meetPair(BoundValue& s1, BoundValue& s2) const;
+	meetPair(const BoundValue& s1, const BoundValue& s2) const;
 };
 
 
+class OverflowerSession;
+
+
+// States are BoundStates, or the bound component of a product's state, see
+// ProductAnalysis.h; overflower.cpp instantiates the transfer for both.
 class BoundTransfer {
+	// where reports and memoized transfers are kept
+	OverflowerSession* session;
+
+	template <typename State>
 	BoundValue
-	getBoundValueFor(llvm::Value* v, BoundState& state) const;
+	getBoundValueFor(llvm::Value* v, State& state) const;
 
+	template <typename State>
 	BoundValue
 	evaluateBinaryOperator(llvm::BinaryOperator& binOp,
-						   BoundState& state) const;
+						   State& state) const;
 
+	template <typename State>
 	BoundValue
-	evaluateCast(llvm::CastInst& castOp, BoundState& state) const;
+	evaluateCast(llvm::CastInst& castOp, State& state) const;
 
 public:
+	BoundTransfer() = delete;
+
+	explicit BoundTransfer(OverflowerSession& session) : session(&session) {}
+
+	template <typename State>
 	void
-	operator()(llvm::Instruction& i, BoundState& state, std::vector<unsigned>& context);
+	operator()(llvm::Instruction& i, State& state, std::vector<unsigned>& context);
 };
 
 
-void
-printErrors(std::ostream& out);
+// knobs shared by the overflower tool and pass
+struct BoundOptions {
+	// functions with at least this many blocks iterate their independent
+	// CFG regions in parallel, 0 disables
+	unsigned parallelBlocks = 0;
+	// worker threads for parallel regions, 0 uses the hardware concurrency
+	unsigned threads = 0;
+	// assign closed form ranges to induction variables of counted loops
+	bool accelerateLoops = true;
+	// only analyze functions that can reach a bounds check from module level
+	bool pruneIrrelevant = true;
+	// replay transfers of pure instructions whose operands did not change;
+	// off until it shows a wall time or peak RSS win
+	bool cacheTransfers = false;
+	// keep values in states only where they are live and can reach a check
+	bool pruneStates = true;
+	// callees are analyzed in contexts of at most this many call sites
+	int contextDepth = 2;
+	// analyze context insensitively first, then only the call chains leading
+	// to potential errors with contexts of contextDepth; the first pass
+	// analyzes each callee once with Top arguments and takes that summary at
+	// every call
+	bool adaptiveContexts = false;
+	// a function called from one block with several argument tuples is
+	// analyzed for up to this many of them in one traversal, 1 disables
+	unsigned batchLanes = 1;
+	// keep callee summaries within this many megabytes, evicting those that
+	// are cheapest to recompute, 0 keeps every summary
+	unsigned summaryCacheMb = 0;
+	// only analyze the top level functions whose position among those to
+	// analyze is shard modulo shards, for the workers of a sharded run
+	unsigned shard = 0;
+	unsigned shards = 1;
+};
+
+
+// functions containing a gep that needs the dataflow to be decided, along
+// with every function that can call one of them; with callsOut, calls to
+// functions other modules may define count as such geps
+llvm::DenseSet<llvm::Function*>
+relevantFunctions(llvm::Module& m, bool callsOut = false);
+
+
+// ranges of loop header phis that ScalarEvolution describes as affine
+// recurrences in loops with a constant (maximum) backedge taken count
+BoundAcceleration::HeaderValues
+accelerateLoops(llvm::Function& f);
+
+
+// whether the transfer of i reads the state of the operand for more than the
+// value of i, i.e. is the index a gep is checked with
+bool
+checksOperand(llvm::Instruction& i, unsigned operand);
 
 
+// A potential overflow at an access
+struct ErrReport {
+	llvm::Function* f;
+	std::vector<unsigned> context;
+	size_t lineno;
+	size_t buffersize;
+	BOUND access;
+};
+
+
+// one line of a report file: <context>, <function>, <line>, <buffer size>,
+// <lower>:<upper>
 void
-clearReports();
+printReport(std::ostream& out, const ErrReport& report);
+
+
+// key of a call context among potential errors
+unsigned
+contextEncode(const std::vector<unsigned>& context);
+
+
+// operands of a memoized transfer, unary transfers leave rhs undefined
+struct TransferKey {
+	unsigned opcode;
+	Type* type;
+	unsigned lhs;
+	unsigned rhs;
+
+	bool
+	operator == (const TransferKey& other) const {
+		return opcode == other.opcode && type == other.type &&
+			lhs == other.lhs && rhs == other.rhs;
+	}
+};
+
+
+struct TransferKeyHash {
+	size_t
+	operator () (const TransferKey& key) const;
+};
+
+
+class MemoryProfile;
+class SessionCheckpoint;
+
+
+// Collects the converged ranges of analyzed functions and writes them as a
+// memory mappable index, laid out as described in RangeIndex.h.
+class RangeIndexWriter {
+	struct Fact {
+		uint32_t instruction;
+		uint32_t value;
+		int64_t lower;
+		int64_t upper;
+	};
+	std::vector<std::pair<uint64_t, std::vector<Fact> > > functions;
+	llvm::DenseMap<uint64_t, size_t> positions;
+
+public:
+	void
+	add(llvm::Function& f, const BoundResult& results);
+
+	void
+	write(std::ostream& out) const;
+};
+
+
+// Owns everything one analysis run accumulates: the intern table of its
+// bounds, summaries, reports, loop accelerations, statistics and memoized
+// transfers. Sessions share nothing mutable, so independent sessions may
+// analyze modules concurrently. A single session must only be used by one
+// thread at a time.
+class OverflowerSession {
+	friend class BoundTransfer;
+	friend class MemoryProfile;
+	friend class SessionCheckpoint;
+
+	// first, so that it outlives every value of the session
+	BoundFacts facts;
+	BoundOptions options;
+	BoundSummary summaries;
+	// bounds summaries when options.summaryCacheMb is set
+	analysis::BoundedSummaryStore<BoundValue, BoundInfo> summaryStore;
+	// summaries shared with other sessions, used instead of summaryStore
+	analysis::SummaryStore<BoundValue>* sharedSummaries = nullptr;
+	analysis::FixpointStats stats;
+	// shared so each function's loops are examined only once
+	BoundAcceleration loops;
+	// which values states carry, per function
+	analysis::StateLiveness liveness;
+	// last effects of pure instructions, across contexts and functions
+	analysis::TransferCache<BoundValue> effects;
+	// geps analyzed so far, true while every visit proved them in bounds
+	llvm::DenseMap<llvm::Instruction*, bool> provenSafe;
+
+	llvm::DenseSet<ErrReport*> errorLog;
+	analysis::FixpointTrace* trace = nullptr;
+	SessionCheckpoint* checkpoint = nullptr;
+	analysis::ExternalCalls<BoundValue>* externals = nullptr;
+
+	// reports keyed by their encoded call context
+	std::unordered_map<unsigned, llvm::DenseMap<llvm::Value*, ErrReport*> > potentialError;
+	// constants created by folding, per function, for memory attribution;
+	// only counted while analyzing for a MemoryProfile
+	llvm::DenseMap<llvm::Function*, size_t> constantFolds;
+	bool countFolds = false;
+
+	// transfers and constants of this session's modules, keyed on their
+	// types, constants and interned operands
+	std::unordered_map<TransferKey, BoundValue, TransferKeyHash> transfers;
+	llvm::DenseMap<llvm::Constant*, BoundValue> constants;
+
+	// with topArguments, callees are analyzed once with Top arguments rather
+	// than in contexts
+	BoundResult
+	analyzeFunction(llvm::Function& f, bool topArguments);
+
+	BoundResult
+	analyzeFunction(llvm::Function& f, std::vector<BoundValue>& args,
+		const std::vector<unsigned>& context, bool topArguments);
+
+	// analyze the defined functions of m, or only those in the given set,
+	// and only this session's shard of them if sharded
+	void
+	analyzeFunctions(llvm::Module& m, const llvm::DenseSet<llvm::Function*>* only,
+		bool sharded, bool topArguments, MemoryProfile* profile,
+		RangeIndexWriter* index);
+
+	// functions with potential errors and their callers within the context
+	// depth, which see different ranges once contexts are followed
+	llvm::DenseSet<llvm::Function*>
+	escalatedFunctions(llvm::Module& m) const;
+
+	// drop what the context insensitive pass found before the escalated
+	// functions are analyzed again
+	void
+	escalateTo(const llvm::DenseSet<llvm::Function*>& escalated);
+
+	void
+	clearReports();
+
+public:
+	explicit OverflowerSession(const BoundOptions& options = BoundOptions());
+
+	OverflowerSession(const OverflowerSession&) = delete;
+
+	OverflowerSession&
+	operator = (const OverflowerSession&) = delete;
+
+	~OverflowerSession();
+
+	// record analyses, block visits, summary lookups and widening in trace
+	void
+	enableTrace(analysis::FixpointTrace* trace) {
+		this->trace = trace;
+	}
+
+	// record completed functions, summaries and reports in checkpoint,
+	// and skip the functions it has finished
+	void
+	enableCheckpoint(SessionCheckpoint* checkpoint) {
+		this->checkpoint = checkpoint;
+	}
+
+	// take the values of calls to functions the module only declares from
+	// calls, and analyze every function that makes such a call
+	void
+	enableExternalCalls(analysis::ExternalCalls<BoundValue>* calls) {
+		externals = calls;
+	}
+
+	// look up and hand over callee summaries through store, which sees the
+	// bounded store of -summary-cache-mb through getSummaryStore if it wants
+	void
+	shareSummaries(analysis::SummaryStore<BoundValue>* store) {
+		sharedSummaries = store;
+	}
+
+	// the store bounding the summaries, if options.summaryCacheMb is set
+	analysis::SummaryStore<BoundValue>*
+	getSummaryStore() {
+		return options.summaryCacheMb ? &summaryStore : nullptr;
+	}
+
+	// spill summaries evicted from the bounded store to path instead of
+	// dropping them, false if it cannot be written
+	bool
+	spillSummaries(const std::string& path);
+
+	// analyze every defined function of the module, accumulating reports and,
+	// when given, the memory attributed to each function and its ranges
+	void
+	analyzeModule(llvm::Module& m, MemoryProfile* profile = nullptr,
+		RangeIndexWriter* index = nullptr);
+
+	// the values of results are read in a scope of getFacts()
+	BoundResult
+	analyzeFunction(llvm::Function& f);
+
+	// analyze f for args as a callee in context, e.g. called from another
+	// module, with its reports in that context
+	BoundResult
+	analyzeInContext(llvm::Function& f, const std::vector<BoundValue>& args,
+		const std::vector<unsigned>& context);
+
+	// confirmed reports, in no particular order
+	std::vector<ErrReport>
+	getReports() const;
+
+	void
+	printReports(std::ostream& out) const;
+
+	// Add the reports, proven safe accesses and statistics of another session
+	// over the same module, e.g. one that analyzed another shard. Accesses
+	// are only proven safe if both sessions prove them, and a report in a
+	// context this session has one for already is dropped.
+	void
+	merge(const OverflowerSession& other);
+
+	// geps proven in bounds in every context they were analyzed in, along
+	// with the loads and stores through them
+	llvm::DenseSet<llvm::Instruction*>
+	getSafeAccesses(llvm::Module& m) const;
+
+	// one line per function with safe accesses, indexing instructions in
+	// order: <function>, <instruction count>, <index>, <index>, ...
+	void
+	printSafeAccesses(llvm::Module& m, std::ostream& out) const;
+
+	// drop reports, summaries and memos, e.g. before the module they refer
+	// to is destroyed
+	void
+	clear();
+
+	const analysis::FixpointStats&
+	getStats() const {
+		return stats;
+	}
+
+	// read in a scope of getFacts()
+	BoundSummary&
+	getSummaries() {
+		return summaries;
+	}
+
+	// the table the values of this session are interned in
+	BoundFacts&
+	getFacts() {
+		return facts;
+	}
+
+	// hits, misses and evictions of the bounded summary store
+	const analysis::SummaryStoreCounters&
+	getSummaryCounters() const {
+		return summaryStore.getCounters();
+	}
+};
+
+
+// read a map written by printSafeAccesses back onto the same module,
+// skipping functions whose instruction count no longer matches
+llvm::DenseSet<llvm::Instruction*>
+readSafeAccesses(llvm::Module& m, std::istream& in);
+
+
+// Approximate heap bytes attributed to the analysis of one function.
+struct FunctionFootprint {
+	llvm::Function* f = nullptr;
+	// converged per instruction states, only live while f is analyzed
+	size_t results = 0;
+	// argument tuples and return values cached for f
+	size_t summaries = 0;
+	// potential and confirmed error reports for accesses within f
+	size_t reports = 0;
+	// upper bound on constants created while folding f's arithmetic
+	size_t constants = 0;
+
+	size_t
+	total() const {
+		return results + summaries + reports + constants;
+	}
+};
+
+
+class MemoryProfile {
+	llvm::DenseMap<llvm::Function*, FunctionFootprint> functions;
+	size_t interned = 0;
+	// peak resident set size in kilobytes at the end of each phase
+	std::vector<std::pair<std::string, size_t> > phases;
+
+	FunctionFootprint&
+	footprintOf(llvm::Function* f);
+
+public:
+	void
+	recordResults(llvm::Function& f, const BoundResult& results);
+
+	void
+	recordSummaries(const BoundSummary& summaries);
+
+	// attribute reports and folded constants and count the interned bounds,
+	// must precede session.clear()
+	void
+	recordReports(const OverflowerSession& session);
+
+	void
+	recordPhase(std::string name);
+
+	// print phase peaks and the topN functions with the largest footprint
+	void
+	print(std::ostream& out, unsigned topN) const;
+};
 
 
 #endif //OVERFLOWER_OVERFLOWER_H
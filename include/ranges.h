@@ -0,0 +1,250 @@
+//
+// Interval backends built on LLVM's own range machinery, selectable in place
+// of BoundValue with -domain, and the product of BoundValue with one of them.
+// All report like OverflowerSession so their results can be compared line
+// for line.
+//
+
+#ifndef OVERFLOWER_RANGES_H
+#define OVERFLOWER_RANGES_H
+
+#include "ProductAnalysis.h"
+#include "overflower.h"
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/IR/ConstantRange.h"
+
+
+enum class Domain {
+	// BoundValue, with int64 bounds, entropy driven widening and contexts
+	Bound,
+	// RangeValue through the same dataflow, contexts and summaries
+	ConstantRange,
+	// LazyValueInfo queried at each access, within one function at a time
+	LazyValueInfo,
+	// BoundValue and RangeValue as one product, in a single traversal
+	Product,
+};
+
+
+// A wrap aware interval at the exact bit width of its value. Like
+// BoundValue, a value without a range is undefined.
+struct RangeValue {
+	optional<llvm::ConstantRange> range;
+	// meets that grew the range on the way to this value; past a limit the
+	// meet goes straight to the full range so loops converge
+	unsigned growth = 0;
+
+	RangeValue() {}
+
+	explicit RangeValue(const llvm::ConstantRange& range, unsigned growth = 0)
+		: range(range), growth(growth) {}
+
+	RangeValue(llvm::Constant* value,
+		llvm::CmpInst::Predicate pred = llvm::CmpInst::ICMP_EQ,
+		const RangeValue* prevState = nullptr);
+
+	RangeValue(const RangeValue& other) = default;
+
+	RangeValue(RangeValue&& other) = default;
+
+	RangeValue&
+	operator = (const RangeValue& other) = default;
+
+	RangeValue&
+	operator = (RangeValue&& other) = default;
+
+	// the values of prevState that satisfy <value> pred other
+	RangeValue(const RangeValue& other,
+		llvm::CmpInst::Predicate pred,
+		const RangeValue* prevState = nullptr);
+
+	bool
+	operator == (const RangeValue& other) const;
+
+	void
+	makeTop();
+};
+
+
+std::ostream&
+operator << (std::ostream& out, const RangeValue& v);
+
+
+struct RangeInfo {
+	// undefined values are never keys, so markers in growth tell these apart
+	static inline RangeValue getEmptyKey() {
+		RangeValue empty;
+		empty.growth = ~0u;
+		return empty;
+	}
+	static inline RangeValue getTombstoneKey() {
+		RangeValue tombstone;
+		tombstone.growth = ~0u - 1;
+		return tombstone;
+	}
+	static unsigned getHashValue(const RangeValue& v) {
+		if (!v.range) {
+			return v.growth;
+		}
+		return llvm::hash_combine(v.range->getLower(), v.range->getUpper());
+	}
+	static bool isEqual(const RangeValue& lhs, const RangeValue& rhs) {
+		if (!lhs.range || !rhs.range) {
+			return !lhs.range && !rhs.range && lhs.growth == rhs.growth;
+		}
+		return lhs == rhs;
+	}
+};
+
+
+using RangeState = analysis::AbstractState<RangeValue>;
+using RangeResult = analysis::DataflowResult<RangeValue>;
+using RangeSummary = analysis::Summary<RangeValue, RangeInfo>;
+using RangeAcceleration = analysis::LoopAcceleration<RangeValue>;
+
+
+class RangeMeet : public analysis::Meet<RangeValue, RangeMeet> {
+public:
+	RangeValue
+	meetPair(const RangeValue& s1, const RangeValue& s2) const;
+
+	// unions the range of src into dst without building a new value
+	bool
+	meetInto(RangeValue& dst, const RangeValue& src) const;
+};
+
+
+class RangeSession;
+
+
+// States are RangeStates, or the range component of a product's state;
+// ranges.cpp instantiates the transfer for both.
+class RangeTransfer {
+	RangeSession* session = nullptr;
+
+public:
+	RangeTransfer() = default;
+
+	explicit RangeTransfer(RangeSession& session) : session(&session) {}
+
+	template <typename State>
+	void
+	operator()(llvm::Instruction& i, State& state, std::vector<unsigned>& context);
+};
+
+
+// ScalarEvolution's signed ranges of affine loop header phis
+RangeAcceleration::HeaderValues
+accelerateRangeLoops(llvm::Function& f);
+
+
+// Runs RangeValue through the dataflow with the contexts, summaries, loop
+// acceleration and pruning of OverflowerSession. Region parallelism, lanes,
+// the transfer cache and adaptive contexts are specific to BoundValue.
+class RangeSession {
+	friend class RangeTransfer;
+
+	BoundOptions options;
+	RangeSummary summaries;
+	analysis::FixpointStats stats;
+	RangeAcceleration loops;
+	analysis::StateLiveness liveness;
+
+	llvm::DenseSet<ErrReport*> errorLog;
+	std::unordered_map<unsigned, llvm::DenseMap<llvm::Value*, ErrReport*> > potentialError;
+
+public:
+	explicit RangeSession(const BoundOptions& options = BoundOptions());
+
+	RangeSession(const RangeSession&) = delete;
+
+	RangeSession&
+	operator = (const RangeSession&) = delete;
+
+	~RangeSession();
+
+	void
+	analyzeModule(llvm::Module& m);
+
+	RangeResult
+	analyzeFunction(llvm::Function& f);
+
+	// confirmed reports, in no particular order
+	std::vector<ErrReport>
+	getReports() const;
+
+	// drop reports, summaries and what is cached per function, e.g. before
+	// the module they refer to is destroyed
+	void
+	clear();
+
+	const analysis::FixpointStats&
+	getStats() const {
+		return stats;
+	}
+};
+
+
+using BoundRangeProduct = analysis::Product<
+	analysis::Domain<BoundValue, BoundTransfer, BoundMeet, BoundInfo>,
+	analysis::Domain<RangeValue, RangeTransfer, RangeMeet, RangeInfo> >;
+using BoundRangeValue = BoundRangeProduct::Value;
+using BoundRangeState = BoundRangeProduct::State;
+using BoundComponentState = analysis::ComponentState<BoundRangeValue, 0>;
+using RangeComponentState = analysis::ComponentState<BoundRangeValue, 1>;
+using BoundRangeResult = analysis::DataflowResult<BoundRangeValue>;
+using BoundRangeSummary = analysis::Summary<BoundRangeValue, BoundRangeProduct::Info>;
+using BoundRangeAcceleration = analysis::LoopAcceleration<BoundRangeValue>;
+
+
+// Runs BoundValue and RangeValue through the dataflow as one product, so both
+// domains visit each block in the same traversal, with the contexts,
+// summaries, loop acceleration and pruning of RangeSession. Each domain logs
+// reports to a session of its own, and an access is reported only when
+// neither domain proves it, with the bounds both allow.
+class ProductSession {
+	BoundOptions options;
+	// where the transfers of each domain log reports and keep what they cache
+	OverflowerSession bounds;
+	RangeSession ranges;
+	BoundRangeSummary summaries;
+	analysis::FixpointStats stats;
+	BoundRangeAcceleration loops;
+	analysis::StateLiveness liveness;
+
+public:
+	explicit ProductSession(const BoundOptions& options = BoundOptions());
+
+	ProductSession(const ProductSession&) = delete;
+
+	ProductSession&
+	operator = (const ProductSession&) = delete;
+
+	void
+	analyzeModule(llvm::Module& m);
+
+	// the values of results are read in a scope of the bound domain's facts
+	BoundRangeResult
+	analyzeFunction(llvm::Function& f);
+
+	// reports both domains confirm, in no particular order
+	std::vector<ErrReport>
+	getReports() const;
+
+	const analysis::FixpointStats&
+	getStats() const {
+		return stats;
+	}
+};
+
+
+// Reports from LazyValueInfo's range of each access index at the access.
+// Every function is analyzed once, without contexts, so indices derived
+// from arguments or call results are unbounded. Each function counts as one
+// analysis in stats.
+std::vector<ErrReport>
+lazyValueReports(llvm::Module& m, analysis::FixpointStats& stats);
+
+
+#endif //OVERFLOWER_RANGES_H
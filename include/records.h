@@ -0,0 +1,54 @@
+//
+// Tab separated text records, as written by checkpoints and module
+// summaries.
+//
+
+#ifndef OVERFLOWER_RECORDS_H
+#define OVERFLOWER_RECORDS_H
+
+#include "overflower.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+std::vector<std::string>
+splitFields(const std::string& line);
+
+
+// a whole field as a decimal integer
+bool
+parseInt(const std::string& field, int64_t& value);
+
+
+// <lower>:<upper>, or undef when there is no range
+void
+appendRange(std::string& record, const BOUND& range);
+
+
+bool
+parseRange(const std::string& field, BOUND& range);
+
+
+// call site lines separated by colons, empty for the top level
+void
+appendContext(std::string& record, const std::vector<unsigned>& context);
+
+
+bool
+parseContext(const std::string& field, std::vector<unsigned>& context);
+
+
+// a type as LLVM prints it, which is how records name types across runs
+std::string
+typeName(llvm::Type* type);
+
+
+// every type a value of m has, along with the types they are made of, by
+// typeName
+std::unordered_map<std::string, llvm::Type*>
+moduleTypes(llvm::Module& m);
+
+
+#endif //OVERFLOWER_RECORDS_H
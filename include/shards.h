@@ -0,0 +1,131 @@
+//
+// Sharded analysis of a module in forked worker processes, which share
+// callee summaries through shared memory.
+//
+
+#ifndef OVERFLOWER_SHARDS_H
+#define OVERFLOWER_SHARDS_H
+
+#include "overflower.h"
+
+#include <string>
+#include <vector>
+
+
+struct SharedSummaryCounters {
+	unsigned long published = 0; // summaries added to the table
+	unsigned long hits = 0;      // lookups answered by another worker's summary
+	unsigned long dropped = 0;   // summaries left out since their slots were taken
+};
+
+
+// A fixed size open addressing table of callee summaries, in memory shared
+// by every process forked after it was created. It is lock free: a slot is
+// claimed with a compare and swap of its state, filled in and then published
+// with a release store, and readers only look at published slots. Slots are
+// never rewritten, so a worker that dies while filling one merely leaves it
+// claimed. When every slot within reach of a key is taken, its summary is
+// not shared.
+//
+// Keys are the function and a 128 bit digest of the whole argument facts,
+// their ranges, entropy and types, along with the pass of the adaptive
+// analysis they were computed in. So a worker only takes summaries computed
+// for exactly the arguments it has, even though a session tells arguments
+// apart by their ranges alone and may reuse a summary computed for another
+// entropy or type. Workers fork once the module was parsed, so functions and
+// types have the same address in all of them and are stored as pointers.
+//
+// In each worker, the table serves as the summary store of its session: a
+// summary the session lacks is copied from the table, and every summary the
+// session completes is published to it.
+class SharedSummaryTable : public analysis::SummaryStore<BoundValue> {
+	struct Header;
+	struct Slot;
+
+	void* mapping = nullptr;
+	size_t bytes = 0;
+	Header* header = nullptr;
+	Slot* slots = nullptr;
+	size_t capacity = 0;
+	// pass of the adaptive analysis, part of every key
+	unsigned pass = 0;
+
+	BoundSummary* summaries = nullptr;
+	analysis::SummaryStore<BoundValue>* next = nullptr;
+
+	Slot*
+	find(llvm::Function* f, const std::vector<BoundValue>& args);
+
+	void
+	publish(llvm::Function* f, const std::vector<BoundValue>& args,
+		const BoundValue& summary);
+
+public:
+	// map a table of about the given size, see isMapped
+	explicit SharedSummaryTable(size_t bytes);
+
+	SharedSummaryTable(const SharedSummaryTable&) = delete;
+
+	SharedSummaryTable&
+	operator = (const SharedSummaryTable&) = delete;
+
+	~SharedSummaryTable();
+
+	bool
+	isMapped() const {
+		return nullptr != slots;
+	}
+
+	// serve a session with these summaries, and with the bounded store of
+	// -summary-cache-mb in front of the table if next is given
+	void
+	attach(BoundSummary& summaries, analysis::SummaryStore<BoundValue>* next);
+
+	bool
+	lookup(llvm::Function* f, const std::vector<BoundValue>& args,
+		bool count) override;
+
+	void
+	admit(llvm::Function* f, const std::vector<BoundValue>& args,
+		unsigned long cost) override;
+
+	void
+	invalidate() override;
+
+	// totals of every worker
+	SharedSummaryCounters
+	getCounters() const;
+};
+
+
+struct ShardOptions {
+	// worker processes, each analyzing one shard
+	unsigned workers = 2;
+	// size of the shared summary table
+	unsigned tableMb = 64;
+	// seconds between the checkpoints through which workers hand over their
+	// results
+	unsigned checkpointInterval = 60;
+};
+
+
+struct ShardResults {
+	// shards whose worker crashed, was killed or failed
+	std::vector<unsigned> failed;
+	SharedSummaryCounters summaries;
+};
+
+
+// Analyze m in forked workers, each taking its shard of the top level
+// functions as BoundOptions::shard describes, and merge their reports, safe
+// accesses and counters into session. Workers hand over their results
+// through checkpoint files, so one that dies only loses the functions it
+// had not checkpointed yet. Returns false with a reason in error if the
+// workers could not be started.
+bool
+analyzeSharded(llvm::Module& m, const BoundOptions& options,
+	const ShardOptions& shards, OverflowerSession& session,
+	ShardResults& results, std::string& error);
+
+
+#endif //OVERFLOWER_SHARDS_H
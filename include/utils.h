@@ -31,4 +31,11 @@ std::vector<unsigned>
 getByteWidth(llvm::Type* ty, unsigned& total);
 
 
+// peak resident set size of the current process in kilobytes, or of its
+// largest child waited for if larger, i.e. the largest worker of a sharded
+// run
+size_t
+getPeakRSS();
+
+
 #endif //OVERFLOWER_UTILS_H
@@ -0,0 +1,18 @@
+
+int
+step(int i, int j) {
+  unsigned buffer[8] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+  };
+  buffer[i] = 1;
+  return i + j;
+}
+
+
+int
+main(int argc, char **argv) {
+  int a = step(1, 3);
+  int b = step(a, 3);
+  int c = step(b, 3);
+  return step(c, 3);
+}
@@ -0,0 +1,119 @@
+#!/bin/bash
+#
+# Checks the runtime checked builds of -safe-map and -overflower-checks. Every
+# input is analyzed with -safe-map and run through the checks pass twice:
+#
+#   plain  the accesses proven safe must be elided, and every other checkable
+#          access must get a trap: the checks with the map and those elided
+#          add up to the checks without one
+#   asan   with the functions marked sanitize_address, no traps are added
+#          and the proven loads and stores are marked !nosanitize instead
+#
+# The checked IR must pass the verifier both times.
+#
+# Inputs are the bundled ll/*.ll files (see `make llvmasm`) plus any .ll
+# files found in directories given on the command line. OPT may carry flags,
+# e.g. OPT="opt -enable-new-pm=0" for an opt that defaults to the new pass
+# manager.
+#
+# Usage:
+#   ./checks.sh [dir ...]
+#
+
+OVERFLOWER=${OVERFLOWER:-../cmake-build-debug/bin/overflower}
+PLUGIN=${PLUGIN:-$(dirname "$OVERFLOWER")/../lib/OverflowerPass.so}
+OPT=${OPT:-opt}
+
+for file in "$OVERFLOWER" "$PLUGIN"; do
+  if [ ! -e "$file" ]; then
+    echo "$(basename "$file") not found at $file (set OVERFLOWER or PLUGIN)" >&2
+    exit 2
+  fi
+done
+
+OUTDIR=$(mktemp -d)
+trap 'rm -rf "$OUTDIR"' EXIT
+
+INPUTS=$(ls ll/*.ll 2>/dev/null)
+for dir in "$@"; do
+  INPUTS="$INPUTS $(find "$dir" -name '*.ll' | sort)"
+done
+
+if [ -z "$(echo $INPUTS)" ]; then
+  echo "no inputs; run \`make llvmasm\` or pass directories of .ll files" >&2
+  exit 2
+fi
+
+# runs the checks pass on $1 with the safe map $2 into $3, printing its
+# counts as "<checked> <elided> <unsanitized>"
+check() {
+  $OPT -load "$PLUGIN" -overflower-checks -overflower-safe-map="$2" \
+    -overflower-checks-stats "$1" -S -o "$3" 2>&1 >/dev/null |
+    sed -n 's/^overflower-checks: \([0-9]*\) checked, \([0-9]*\) elided, \([0-9]*\) unsanitized$/\1 \2 \3/p'
+}
+
+# the traps or !nosanitize accesses in the IR at $2
+count() {
+  case $1 in
+    trap) grep -c 'call void @llvm.trap()' "$2" ;;
+    nosanitize) grep -c '!nosanitize' "$2" ;;
+  esac
+}
+
+fail() {
+  echo "FAIL  $input: $1"
+  failed=1
+}
+
+failed=0
+checked=0
+for input in $INPUTS; do
+  name=$(basename "${input%.*}")
+  dir=$OUTDIR/$name
+  mkdir -p "$dir"
+
+  if ! "$OVERFLOWER" "$input" "$dir/report.csv" -safe-map="$dir/safe"; then
+    fail "overflower exited with an error"
+    continue
+  fi
+  : > "$dir/none"
+  checked=$((checked + 1))
+
+  read -r mapped elided unsanitized < <(check "$input" "$dir/safe" "$dir/plain.ll")
+  read -r all _ _ < <(check "$input" "$dir/none" "$dir/all.ll")
+  if [ -z "$mapped" ] || [ -z "$all" ]; then
+    fail "the checks pass failed"
+    continue
+  fi
+  # inputs may have been checked before, so only what the pass added counts
+  traps=$(($(count trap "$dir/plain.ll") - $(count trap "$input")))
+  if [ $((mapped + elided)) -ne "$all" ] || [ "$traps" -ne "$mapped" ] ||
+     [ "$unsanitized" -ne 0 ]; then
+    fail "$mapped checked and $elided elided of $all checkable, $traps traps"
+  fi
+
+  sed -E 's/^(define .*\))( #[0-9]+)?( !dbg ![0-9]+)? \{$/\1 sanitize_address\2\3 {/' \
+    "$input" > "$dir/asan.ll"
+  if [ "$(grep -c '^define' "$dir/asan.ll")" -ne \
+       "$(grep -c '^define.* sanitize_address' "$dir/asan.ll")" ]; then
+    fail "cannot mark every function sanitize_address"
+    continue
+  fi
+  read -r mapped elided unsanitized < <(check "$dir/asan.ll" "$dir/safe" "$dir/asan.out.ll")
+  if [ -z "$mapped" ]; then
+    fail "the checks pass failed on sanitized functions"
+    continue
+  fi
+  traps=$(($(count trap "$dir/asan.out.ll") - $(count trap "$input")))
+  marked=$(($(count nosanitize "$dir/asan.out.ll") -
+            $(count nosanitize "$input")))
+  if [ "$mapped" -ne 0 ] || [ "$elided" -ne 0 ] || [ "$traps" -ne 0 ] ||
+     [ "$marked" -ne "$unsanitized" ]; then
+    fail "sanitized functions got checks, or $marked of $unsanitized marked"
+  fi
+done
+
+if [ $failed -eq 0 ]; then
+  echo "checks OK, $checked inputs"
+fi
+exit $failed
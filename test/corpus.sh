@@ -0,0 +1,130 @@
+#!/bin/bash
+#
+# Corpus runner for the overflower tool. Every input is analyzed once and
+#   1. the report is compared against the golden CSV in expect_out/ (when one
+#      exists for that input),
+#   2. wall time, peak RSS and fixpoint counters are collected via -perf-stats,
+#   3. those numbers are compared against a baseline file, failing when any
+#      input regresses beyond the configured threshold.
+#
+# Inputs are the bundled ll/*.ll files (see `make llvmasm`) plus any .ll/.bc
+# files found in directories given on the command line.
+#
+# Usage:
+#   ./corpus.sh [-b baseline.csv] [-t percent] [-s slack ms] [-f flags] [-u]
+#               [dir ...]
+#
+#   -b  baseline file (default: baseline.csv)
+#   -t  allowed regression in percent for every metric (default: 20)
+#   -s  absolute wall time slack in ms, hides noise on tiny inputs (default: 50)
+#   -f  further overflower options, for modes that must not change reports,
+#       e.g. -f -batch-lanes=4
+#   -u  record a new baseline instead of checking against the old one
+#
+# The baseline is a CSV with one row per input:
+#   <input>, <wall ms>, <peak rss kb>, <analyses>, <block visits>, <transfers>
+#
+
+OVERFLOWER=${OVERFLOWER:-../cmake-build-debug/bin/overflower}
+BASELINE=baseline.csv
+THRESHOLD=20
+SLACK=50
+FLAGS=
+UPDATE=0
+
+while getopts "b:t:s:f:u" opt; do
+  case $opt in
+    b) BASELINE=$OPTARG ;;
+    t) THRESHOLD=$OPTARG ;;
+    s) SLACK=$OPTARG ;;
+    f) FLAGS=$OPTARG ;;
+    u) UPDATE=1 ;;
+    *) exit 2 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+if [ ! -x "$OVERFLOWER" ]; then
+  echo "overflower binary not found at $OVERFLOWER (set OVERFLOWER)" >&2
+  exit 2
+fi
+
+OUTDIR=$(mktemp -d)
+trap 'rm -rf "$OUTDIR"' EXIT
+CURRENT=$OUTDIR/current.csv
+: > "$CURRENT"
+
+INPUTS=$(ls ll/*.ll 2>/dev/null)
+for dir in "$@"; do
+  INPUTS="$INPUTS $(find "$dir" -name '*.ll' -o -name '*.bc' | sort)"
+done
+
+if [ -z "$(echo $INPUTS)" ]; then
+  echo "no inputs; run \`make llvmasm\` or pass bitcode directories" >&2
+  exit 2
+fi
+
+# golden reports are unordered, so compare them as sorted sets of lines
+normalize() {
+  sed -e '/^[[:space:]]*$/d' "$1" | sort
+}
+
+failed=0
+for input in $INPUTS; do
+  name=$(basename "${input%.*}")
+  report=$OUTDIR/$name.csv
+  stats=$OUTDIR/$name.stats
+
+  if ! "$OVERFLOWER" "$input" "$report" -perf-stats="$stats" $FLAGS; then
+    echo "FAIL  $input: analysis exited with an error"
+    failed=1
+    continue
+  fi
+  echo "$input, $(cat "$stats")" >> "$CURRENT"
+
+  golden=expect_out/$name.csv
+  case $input in
+    ll/*)
+      if [ -f "$golden" ] &&
+         ! diff <(normalize "$golden") <(normalize "$report") > /dev/null; then
+        echo "FAIL  $input: report differs from $golden"
+        diff <(normalize "$golden") <(normalize "$report") | sed 's/^/      /'
+        failed=1
+      fi
+      ;;
+  esac
+done
+
+if [ $UPDATE -eq 1 ]; then
+  cp "$CURRENT" "$BASELINE"
+  echo "baseline written to $BASELINE"
+  exit $failed
+fi
+
+if [ ! -f "$BASELINE" ]; then
+  echo "no baseline at $BASELINE; skipping regression gate (use -u to record)"
+  exit $failed
+fi
+
+awk -F', ' -v thr="$THRESHOLD" -v slack="$SLACK" '
+  NR == FNR { for (i = 2; i <= NF; i++) base[$1, i] = $i; seen[$1] = 1; next }
+  !($1 in seen) { print "NEW   " $1; next }
+  {
+    split("wall_ms rss_kb analyses block_visits transfers", names, " ")
+    for (i = 2; i <= NF; i++) {
+      limit = base[$1, i] * (1 + thr / 100)
+      if (i == 2) limit += slack
+      if ($i > limit) {
+        printf "SLOW  %s: %s %s -> %s (limit %.0f)\n",
+               $1, names[i - 1], base[$1, i], $i, limit
+        bad = 1
+      }
+    }
+  }
+  END { exit bad }
+' "$BASELINE" "$CURRENT" || failed=1
+
+if [ $failed -eq 0 ]; then
+  echo "corpus OK"
+fi
+exit $failed
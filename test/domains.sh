@@ -0,0 +1,117 @@
+#!/bin/bash
+#
+# Compares the abstract domains selectable with -domain. Every input is
+# analyzed once per domain, and for each a row is printed with the wall time,
+# peak RSS and fixpoint counters from -perf-stats, the number of reports and
+# how far those reports agree with the default bound domain.
+#
+# Agreement is the Jaccard index of the report keys (context, function, line)
+# against those of bound: 1 when both report the same accesses, 0 when they
+# have none in common. Inputs where neither reports anything agree fully.
+# Access ranges are left out of the key, since the domains are expected to
+# differ in precision. Note lvi reports have no contexts, so they only agree
+# with bound on functions bound analyzes without a calling context. product
+# runs bound and constantrange in one traversal and only reports what both
+# do, so its block visits are those of a single domain.
+#
+# Inputs are the bundled ll/*.ll files (see `make llvmasm`) plus any .ll/.bc
+# files found in directories given on the command line.
+#
+# Usage:
+#   ./domains.sh [-o table.csv] [dir ...]
+#
+#   -o  also write the table to this file
+#
+# The table is a CSV with one row per input and domain:
+#   <input>, <domain>, <wall ms>, <peak rss kb>, <analyses>, <block visits>,
+#   <transfers>, <reports>, <agreement>
+#
+
+OVERFLOWER=${OVERFLOWER:-../cmake-build-debug/bin/overflower}
+DOMAINS="bound constantrange lvi product"
+TABLE=
+
+while getopts "o:" opt; do
+  case $opt in
+    o) TABLE=$OPTARG ;;
+    *) exit 2 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+if [ ! -x "$OVERFLOWER" ]; then
+  echo "overflower binary not found at $OVERFLOWER (set OVERFLOWER)" >&2
+  exit 2
+fi
+
+OUTDIR=$(mktemp -d)
+trap 'rm -rf "$OUTDIR"' EXIT
+CURRENT=$OUTDIR/domains.csv
+: > "$CURRENT"
+
+INPUTS=$(ls ll/*.ll 2>/dev/null)
+for dir in "$@"; do
+  INPUTS="$INPUTS $(find "$dir" -name '*.ll' -o -name '*.bc' | sort)"
+done
+
+if [ -z "$(echo $INPUTS)" ]; then
+  echo "no inputs; run \`make llvmasm\` or pass bitcode directories" >&2
+  exit 2
+fi
+
+# the context, function and line of every report, one per line
+keys() {
+  sed -e '/^[[:space:]]*$/d' "$1" | awk -F', ' '{ print $1 ", " $2 ", " $3 }' |
+    sort -u
+}
+
+failed=0
+for input in $INPUTS; do
+  name=$(basename "${input%.*}")
+  for domain in $DOMAINS; do
+    report=$OUTDIR/$name.$domain.csv
+    stats=$OUTDIR/$name.$domain.stats
+
+    if ! "$OVERFLOWER" "$input" "$report" -domain=$domain \
+         -perf-stats="$stats"; then
+      echo "FAIL  $input: -domain=$domain exited with an error" >&2
+      failed=1
+      continue
+    fi
+    keys "$report" > "$report.keys"
+
+    reference=$OUTDIR/$name.bound.csv.keys
+    both=$(comm -12 "$reference" "$report.keys" | wc -l)
+    either=$(sort -u "$reference" "$report.keys" | wc -l)
+    agreement=$(awk -v b=$both -v e=$either \
+      'BEGIN { printf "%.2f", e == 0 ? 1 : b / e }')
+
+    echo "$input, $domain, $(cat "$stats"), $(wc -l < "$report.keys"), $agreement" \
+      >> "$CURRENT"
+  done
+done
+
+cat "$CURRENT"
+if [ -n "$TABLE" ]; then
+  cp "$CURRENT" "$TABLE"
+fi
+
+# totals per domain, so the tradeoff reads at a glance
+awk -F', ' '
+  {
+    wall[$2] += $3; if ($4 > rss[$2]) rss[$2] = $4
+    reports[$2] += $8; agree[$2] += $9; inputs[$2]++
+  }
+  END {
+    split("bound constantrange lvi product", order, " ")
+    for (i = 1; i <= 4; i++) {
+      d = order[i]
+      if (inputs[d]) {
+        printf "%-14s wall %.1f ms, peak rss %d kb, %d reports, agreement %.2f\n",
+               d, wall[d], rss[d], reports[d], agree[d] / inputs[d]
+      }
+    }
+  }
+' "$CURRENT" >&2
+
+exit $failed
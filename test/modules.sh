@@ -0,0 +1,117 @@
+#!/bin/bash
+#
+# Checks separate module analysis against the whole program. Every input
+# that defines main along with other functions is split with llvm-extract
+# into a module holding main and one holding the rest. Both are analyzed
+# with -module-summary, linked with overflower-link and analyzed again with
+# the imports it wrote, until the imports stop changing. The reports of the
+# two modules together must then be those of the whole input.
+#
+# Each round carries values across one more module boundary: a call takes a
+# round to have its callee analyzed with its arguments and another to get
+# the return value back, so chains of calls take two rounds per call.
+#
+# Inputs are the bundled ll/*.ll files (see `make llvmasm`) plus any .ll/.bc
+# files found in directories given on the command line.
+#
+# Usage:
+#   ./modules.sh [-r rounds] [dir ...]
+#
+#   -r  most rounds of linking and analyzing again (default: 10)
+#
+
+OVERFLOWER=${OVERFLOWER:-../cmake-build-debug/bin/overflower}
+OVERFLOWER_LINK=${OVERFLOWER_LINK:-$(dirname "$OVERFLOWER")/overflower-link}
+LLVM_EXTRACT=${LLVM_EXTRACT:-llvm-extract}
+ROUNDS=10
+
+while getopts "r:" opt; do
+  case $opt in
+    r) ROUNDS=$OPTARG ;;
+    *) exit 2 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+for tool in "$OVERFLOWER" "$OVERFLOWER_LINK"; do
+  if [ ! -x "$tool" ]; then
+    echo "$(basename "$tool") binary not found at $tool" \
+         "(set OVERFLOWER or OVERFLOWER_LINK)" >&2
+    exit 2
+  fi
+done
+
+OUTDIR=$(mktemp -d)
+trap 'rm -rf "$OUTDIR"' EXIT
+
+INPUTS=$(ls ll/*.ll 2>/dev/null)
+for dir in "$@"; do
+  INPUTS="$INPUTS $(find "$dir" -name '*.ll' -o -name '*.bc' | sort)"
+done
+
+if [ -z "$(echo $INPUTS)" ]; then
+  echo "no inputs; run \`make llvmasm\` or pass bitcode directories" >&2
+  exit 2
+fi
+
+normalize() {
+  sed -e '/^[[:space:]]*$/d' "$@" | sort
+}
+
+failed=0
+checked=0
+for input in $INPUTS; do
+  name=$(basename "${input%.*}")
+  dir=$OUTDIR/$name
+  mkdir -p "$dir"
+
+  # a is main, b the rest; inputs with nothing besides main are left out
+  if ! "$LLVM_EXTRACT" -S -func=main "$input" -o "$dir/a.ll" 2> /dev/null ||
+     ! "$LLVM_EXTRACT" -S -delete -func=main "$input" -o "$dir/b.ll" \
+       2> /dev/null ||
+     ! grep -q '^define' "$dir/b.ll"; then
+    continue
+  fi
+
+  ok=1
+  for m in a b; do
+    "$OVERFLOWER" "$dir/$m.ll" "$dir/$m.csv" -module-summary="$dir/$m.0" ||
+      ok=0
+  done
+  rounds=0
+  for r in $(seq 1 $ROUNDS); do
+    p=$((r - 1))
+    "$OVERFLOWER_LINK" "$dir/a.$p" "$dir/b.$p" || ok=0
+    if [ $r -gt 1 ] &&
+       cmp -s "$dir/a.$p.imports" "$dir/a.$((p - 1)).imports" &&
+       cmp -s "$dir/b.$p.imports" "$dir/b.$((p - 1)).imports"; then
+      break
+    fi
+    rounds=$r
+    for m in a b; do
+      "$OVERFLOWER" "$dir/$m.ll" "$dir/$m.csv" \
+        -import-summary="$dir/$m.$p.imports" -module-summary="$dir/$m.$r" ||
+        ok=0
+    done
+  done
+  "$OVERFLOWER" "$input" "$dir/whole.csv" || ok=0
+  if [ $ok -eq 0 ]; then
+    echo "FAIL  $input: a separate analysis or link exited with an error"
+    failed=1
+    continue
+  fi
+
+  checked=$((checked + 1))
+  if ! diff <(normalize "$dir/whole.csv") \
+            <(normalize "$dir/a.csv" "$dir/b.csv") > /dev/null; then
+    echo "FAIL  $input: modules report differently after $rounds rounds"
+    diff <(normalize "$dir/whole.csv") <(normalize "$dir/a.csv" "$dir/b.csv") |
+      sed 's/^/      /'
+    failed=1
+  fi
+done
+
+if [ $failed -eq 0 ]; then
+  echo "modules OK, $checked inputs split"
+fi
+exit $failed
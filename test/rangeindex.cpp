@@ -0,0 +1,98 @@
+//
+// Reads a -range-index back through rangeindex::Reader, see rangeindex.sh.
+// Built with nothing but include/RangeIndex.h, as its consumers are.
+//
+
+#include "RangeIndex.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+
+// Checks that every fact in the columns of the index at path is found by
+// Reader::lookup with its bounds, that lookups of values without a fact
+// fail, and that each function named after it has facts. Prints the number
+// of functions and facts, or the first problem found.
+int
+main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <index> [function ...]\n", argv[0]);
+    return 2;
+  }
+
+  rangeindex::Reader reader;
+  if (!reader.open(argv[1])) {
+    printf("%s cannot be read as a range index\n", argv[1]);
+    return 1;
+  }
+
+  // the columns as the header lays them out, independently of the reader
+  FILE* file = fopen(argv[1], "rb");
+  std::vector<char> data;
+  char buffer[4096];
+  for (size_t read; (read = fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+    data.insert(data.end(), buffer, buffer + read);
+  }
+  fclose(file);
+  const auto* header =
+    reinterpret_cast<const rangeindex::Header*>(data.data());
+  const auto* functions = reinterpret_cast<const rangeindex::Function*>(
+    data.data() + header->functions);
+  const auto* instructions =
+    reinterpret_cast<const uint32_t*>(data.data() + header->instructions);
+  const auto* values =
+    reinterpret_cast<const uint32_t*>(data.data() + header->values);
+  const auto* lowers =
+    reinterpret_cast<const int64_t*>(data.data() + header->lowers);
+  const auto* uppers =
+    reinterpret_cast<const int64_t*>(data.data() + header->uppers);
+
+  for (uint32_t f = 0; f < header->functionCount; f++) {
+    const rangeindex::Function& function = functions[f];
+    if (f > 0 && functions[f - 1].hash >= function.hash) {
+      printf("functions are not sorted by hash at %u\n", f);
+      return 1;
+    }
+    for (uint64_t fact = function.firstFact;
+         fact < function.firstFact + function.factCount; fact++) {
+      int64_t lower = 0;
+      int64_t upper = 0;
+      if (!reader.lookup(function.hash, instructions[fact], values[fact],
+                         lower, upper)
+          || lower != lowers[fact] || upper != uppers[fact]) {
+        printf("fact %llu of function %u does not read back\n",
+               (unsigned long long)fact, f);
+        return 1;
+      }
+      if (lower > upper) {
+        printf("fact %llu of function %u is an empty range\n",
+               (unsigned long long)fact, f);
+        return 1;
+      }
+      bool last = fact + 1 == function.firstFact + function.factCount
+        || instructions[fact + 1] != instructions[fact];
+      if (last && reader.lookup(function.hash, instructions[fact],
+                                values[fact] + 1, lower, upper)) {
+        printf("a value without a fact reads back in function %u\n", f);
+        return 1;
+      }
+    }
+  }
+
+  for (int a = 2; a < argc; a++) {
+    uint64_t hash = rangeindex::hashName(argv[a], strlen(argv[a]));
+    bool found = false;
+    for (uint32_t f = 0; f < header->functionCount; f++) {
+      found = found || (functions[f].hash == hash && functions[f].factCount);
+    }
+    if (!found) {
+      printf("%s has no facts\n", argv[a]);
+      return 1;
+    }
+  }
+
+  printf("%u functions, %llu facts\n", header->functionCount,
+         (unsigned long long)header->factCount);
+  return 0;
+}
@@ -0,0 +1,71 @@
+#!/bin/bash
+#
+# Checks the -range-index of every input by reading it back with
+# rangeindex.cpp, which only includes include/RangeIndex.h: every fact must
+# be found by rangeindex::Reader with its bounds, and every function the
+# input reports on must have facts. A file that is not an index, the report
+# itself, must be rejected.
+#
+# Inputs are the bundled ll/*.ll files (see `make llvmasm`) plus any .ll/.bc
+# files found in directories given on the command line.
+#
+# Usage:
+#   ./rangeindex.sh [dir ...]
+#
+
+OVERFLOWER=${OVERFLOWER:-../cmake-build-debug/bin/overflower}
+CXX=${CXX:-c++}
+
+if [ ! -x "$OVERFLOWER" ]; then
+  echo "overflower binary not found at $OVERFLOWER (set OVERFLOWER)" >&2
+  exit 2
+fi
+
+OUTDIR=$(mktemp -d)
+trap 'rm -rf "$OUTDIR"' EXIT
+
+if ! "$CXX" -std=c++11 -I../include rangeindex.cpp -o "$OUTDIR/rangeindex"; then
+  echo "rangeindex.cpp does not build" >&2
+  exit 2
+fi
+
+INPUTS=$(ls ll/*.ll 2>/dev/null)
+for dir in "$@"; do
+  INPUTS="$INPUTS $(find "$dir" -name '*.ll' -o -name '*.bc' | sort)"
+done
+
+if [ -z "$(echo $INPUTS)" ]; then
+  echo "no inputs; run \`make llvmasm\` or pass bitcode directories" >&2
+  exit 2
+fi
+
+failed=0
+checked=0
+for input in $INPUTS; do
+  name=$(basename "${input%.*}")
+  report=$OUTDIR/$name.csv
+  index=$OUTDIR/$name.idx
+
+  if ! "$OVERFLOWER" "$input" "$report" -range-index="$index"; then
+    echo "FAIL  $input: overflower exited with an error"
+    failed=1
+    continue
+  fi
+  checked=$((checked + 1))
+
+  # functions reported without a calling context, as those are indexed
+  functions=$(sed -n 's/^, *\([^,]*\),.*/\1/p' "$report" | sort -u)
+  if ! result=$("$OUTDIR/rangeindex" "$index" $functions); then
+    echo "FAIL  $input: $result"
+    failed=1
+  fi
+  if "$OUTDIR/rangeindex" "$report" > /dev/null; then
+    echo "FAIL  $input: the report was read as a range index"
+    failed=1
+  fi
+done
+
+if [ $failed -eq 0 ]; then
+  echo "rangeindex OK, $checked inputs"
+fi
+exit $failed
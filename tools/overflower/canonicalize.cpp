@@ -0,0 +1,80 @@
+//
+// In-process IR preprocessing run before the analysis.
+//
+
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+#include "llvm/PassInfo.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <mutex>
+
+#include "canonicalize.h"
+
+#ifdef OVERFLOWER_CANONICALIZE_H
+
+
+static void
+countSize(llvm::Module& m, size_t& insts, size_t& blocks) {
+	insts = 0;
+	blocks = 0;
+	for (auto& f : m) {
+		blocks += f.size();
+		for (auto& bb : f) {
+			insts += bb.size();
+		}
+	}
+}
+
+
+// once per process, even when modules are canonicalized on several threads
+static void
+initializePasses() {
+	static std::once_flag initialized;
+	std::call_once(initialized, [] () {
+		llvm::PassRegistry& registry = *llvm::PassRegistry::getPassRegistry();
+		llvm::initializeCore(registry);
+		llvm::initializeAnalysis(registry);
+		llvm::initializeTransformUtils(registry);
+		llvm::initializeScalarOpts(registry);
+		llvm::initializeInstCombine(registry);
+		llvm::initializeIPO(registry);
+	});
+}
+
+
+bool
+canonicalize(llvm::Module& m, const std::vector<std::string>& passes,
+	CanonicalizeStats& stats) {
+	countSize(m, stats.instsBefore, stats.blocksBefore);
+	if (passes.empty()) {
+		stats.instsAfter = stats.instsBefore;
+		stats.blocksAfter = stats.blocksBefore;
+		return true;
+	}
+
+	initializePasses();
+	llvm::PassRegistry& registry = *llvm::PassRegistry::getPassRegistry();
+	llvm::legacy::PassManager pm;
+	for (const std::string& name : passes) {
+		if (name.empty()) {
+			continue;
+		}
+		const llvm::PassInfo* info = registry.getPassInfo(name);
+		if (nullptr == info || nullptr == info->getNormalCtor()) {
+			llvm::errs() << "Unknown canonicalization pass: " << name << "\n";
+			return false;
+		}
+		pm.add(info->createPass());
+	}
+	pm.run(m);
+
+	countSize(m, stats.instsAfter, stats.blocksAfter);
+	return true;
+}
+
+
+#endif
@@ -0,0 +1,448 @@
+//
+// Checkpoints of an OverflowerSession, see checkpoint.h.
+//
+
+#include "checkpoint.h"
+#include "records.h"
+
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <unistd.h>
+#include <unordered_map>
+
+
+// Records are tab separated, with a tag first:
+//   overflower checkpoint 1, <module>, <functions>, <instructions>  (header)
+//   T <id> <type>                  a type later records refer to by id
+//   R <context> <function> <instruction> <line> <buffer size> <access> <logged>
+//   G <function> <instruction> <proven safe>
+//   S <function> <argument count> <argument>... <return>
+//   F <function>                   a top level function was analyzed
+//   E <function>...                the adaptive pass escalated to these
+//   C <analyses> <block visits> <transfers>  fixpoint counters so far
+// Values take three fields, <lower>:<upper> or undef, the bits of their
+// entropy and the id of their type, -1 for none.
+static const char* const header = "overflower checkpoint 1";
+
+
+static void
+moduleSize(llvm::Module& m, size_t& functions, size_t& instructions) {
+	functions = 0;
+	instructions = 0;
+	for (auto& f : m) {
+		if (!f.isDeclaration()) {
+			functions++;
+			instructions += std::distance(llvm::inst_begin(f), llvm::inst_end(f));
+		}
+	}
+}
+
+
+unsigned
+SessionCheckpoint::numberOf(llvm::Instruction* i) {
+	llvm::Function* f = i->getFunction();
+	auto known = numbers.find(f);
+	if (numbers.end() == known) {
+		auto& numbered = numbers[f];
+		for (auto& inst : llvm::instructions(*f)) {
+			numbered.insert({&inst, numbered.size()});
+		}
+		return numbered.lookup(i);
+	}
+	return known->second.lookup(i);
+}
+
+
+void
+SessionCheckpoint::appendType(std::string& record, llvm::Type* type) {
+	if (nullptr == type) {
+		record += "\t-1";
+		return;
+	}
+	auto known = typeIds.find(type);
+	unsigned id = 0;
+	if (typeIds.end() != known) {
+		id = known->second;
+	}
+	else {
+		id = typeIds.size();
+		typeIds.insert({type, id});
+		// the type precedes the record that refers to it
+		record.insert(0, "T\t" + std::to_string(id) + "\t" + typeName(type) + "\n");
+	}
+	record += "\t" + std::to_string(id);
+}
+
+
+void
+SessionCheckpoint::appendValue(std::string& record, const BoundValue& value) {
+	appendRange(record, value.range());
+	record += "\t" + std::to_string(llvm::FloatToBits(value.entropy()));
+	appendType(record, value.type());
+}
+
+
+bool
+SessionCheckpoint::create(const std::string& path, llvm::Module& m) {
+	out.open(path, std::ios::out | std::ios::trunc);
+	size_t functions = 0;
+	size_t instructions = 0;
+	moduleSize(m, functions, instructions);
+	out << header << "\t" << m.getModuleIdentifier() << "\t" << functions
+		<< "\t" << instructions << "\n";
+	out.flush();
+	lastWrite = std::chrono::steady_clock::now();
+	return out.good();
+}
+
+
+bool
+SessionCheckpoint::read(const std::string& path, llvm::Module& m,
+	OverflowerSession& session, std::string& error) {
+	std::ifstream in(path);
+	uint64_t valid = 0;
+	if (!in.is_open()) {
+		error = "cannot be read";
+		return false;
+	}
+	return replay(in, m, session, valid, error);
+}
+
+
+bool
+SessionCheckpoint::resume(const std::string& path, llvm::Module& m,
+	OverflowerSession& session, std::string& error) {
+	std::ifstream in(path);
+	if (!in.is_open()) {
+		error = "cannot be read";
+		return false;
+	}
+	uint64_t valid = 0;
+	if (!replay(in, m, session, valid, error)) {
+		return false;
+	}
+	in.close();
+
+	// drop a record cut short, so appending starts on a line of its own
+	std::ifstream size(path, std::ios::binary | std::ios::ate);
+	if (uint64_t(size.tellg()) > valid && 0 != truncate(path.c_str(), valid)) {
+		error = "cannot be truncated to its last complete record";
+		return false;
+	}
+	size.close();
+
+	out.open(path, std::ios::out | std::ios::app);
+	lastWrite = std::chrono::steady_clock::now();
+	if (!out.good()) {
+		error = "cannot be appended to";
+		return false;
+	}
+	return true;
+}
+
+
+bool
+SessionCheckpoint::replay(std::istream& in, llvm::Module& m,
+	OverflowerSession& session, uint64_t& valid, std::string& error) {
+	BoundFacts::Scope scope(&session.facts);
+	std::unordered_map<std::string, llvm::Type*> named;
+	bool typesCollected = false;
+	std::vector<llvm::Type*> types;
+	llvm::DenseMap<llvm::Function*, std::vector<llvm::Instruction*> > insts;
+
+	auto functionNamed = [&] (const std::string& name) -> llvm::Function* {
+		llvm::Function* f = m.getFunction(name);
+		return f && !f->isDeclaration() ? f : nullptr;
+	};
+	auto instruction = [&] (llvm::Function* f,
+			const std::string& field) -> llvm::Instruction* {
+		auto& numbered = insts[f];
+		if (numbered.empty()) {
+			for (auto& i : llvm::instructions(*f)) {
+				numbered.push_back(&i);
+			}
+		}
+		int64_t index = -1;
+		if (!parseInt(field, index) || index < 0 || index >= int64_t(numbered.size())) {
+			return nullptr;
+		}
+		return numbered[index];
+	};
+	// reads the value starting at fields[at]
+	auto value = [&] (const std::vector<std::string>& fields, size_t at,
+			BoundValue& read) {
+		BoundFact fact;
+		int64_t bits = 0;
+		int64_t type = 0;
+		if (at + 3 > fields.size() || !parseRange(fields[at], fact.range)
+				|| !parseInt(fields[at + 1], bits) || !parseInt(fields[at + 2], type)
+				|| type >= int64_t(types.size())) {
+			return false;
+		}
+		fact.range_entropy = llvm::BitsToFloat(bits);
+		fact.boundType = type < 0 ? nullptr : types[type];
+		read = BoundValue(fact);
+		return true;
+	};
+
+	std::string line;
+	size_t lineno = 0;
+	while (std::getline(in, line)) {
+		if (in.eof()) {
+			// the last record lacks its newline, so it was cut short
+			break;
+		}
+		lineno++;
+		auto fields = splitFields(line);
+		auto malformed = [&] () {
+			error = "record " + std::to_string(lineno) + " is malformed";
+			return false;
+		};
+
+		if (1 == lineno) {
+			size_t functions = 0;
+			size_t instructions = 0;
+			moduleSize(m, functions, instructions);
+			if (fields.size() != 4 || fields[0] != header) {
+				error = "is not a checkpoint";
+				return false;
+			}
+			if (fields[1] != m.getModuleIdentifier()
+					|| fields[2] != std::to_string(functions)
+					|| fields[3] != std::to_string(instructions)) {
+				error = "was written for another module";
+				return false;
+			}
+		}
+		else if ("T" == fields[0] && 3 == fields.size()) {
+			int64_t id = 0;
+			if (!parseInt(fields[1], id) || id < 0) {
+				return malformed();
+			}
+			if (!typesCollected) {
+				named = moduleTypes(m);
+				typesCollected = true;
+			}
+			// types the module does not have are dropped from their values
+			auto type = named.find(fields[2]);
+			if (int64_t(types.size()) <= id) {
+				types.resize(id + 1, nullptr);
+			}
+			types[id] = named.end() != type ? type->second : nullptr;
+		}
+		else if ("R" == fields[0] && 8 == fields.size()) {
+			std::vector<unsigned> context;
+			llvm::Function* f = functionNamed(fields[2]);
+			llvm::Instruction* gep = f ? instruction(f, fields[3]) : nullptr;
+			int64_t reportLine = 0;
+			int64_t size = 0;
+			BOUND access;
+			if (!parseContext(fields[1], context) || nullptr == gep
+					|| !parseInt(fields[4], reportLine) || !parseInt(fields[5], size)
+					|| !parseRange(fields[6], access)) {
+				return malformed();
+			}
+			auto& potentials = session.potentialError[contextEncode(context)];
+			auto found = potentials.find(gep);
+			ErrReport* report = nullptr;
+			if (potentials.end() != found) {
+				report = found->second;
+			}
+			else {
+				report = new ErrReport{ f, context, size_t(reportLine), size_t(size), access };
+				potentials.insert({gep, report});
+			}
+			bool logged = "1" == fields[7];
+			if (logged) {
+				session.errorLog.insert(report);
+			}
+			writtenReports[report] = logged || writtenReports.lookup(report);
+		}
+		else if ("G" == fields[0] && 4 == fields.size()) {
+			llvm::Function* f = functionNamed(fields[1]);
+			llvm::Instruction* gep = f ? instruction(f, fields[2]) : nullptr;
+			if (nullptr == gep) {
+				return malformed();
+			}
+			bool safe = "1" == fields[3];
+			session.provenSafe[gep] = safe;
+			writtenSafe[gep] = safe;
+		}
+		else if ("S" == fields[0] && fields.size() >= 3) {
+			llvm::Function* f = functionNamed(fields[1]);
+			int64_t count = 0;
+			if (nullptr == f || !parseInt(fields[2], count) || count < 0
+					|| fields.size() != size_t(3 + 3 * (count + 1))) {
+				return malformed();
+			}
+			Args args(count);
+			BoundValue ret;
+			for (int64_t a = 0; a < count; a++) {
+				if (!value(fields, 3 + 3 * a, args[a])) {
+					return malformed();
+				}
+			}
+			if (!value(fields, 3 + 3 * count, ret)) {
+				return malformed();
+			}
+			session.summaries[f][args] = ret;
+			writtenSummaries[f].insert(args);
+			if (session.options.summaryCacheMb) {
+				// the cost of the summary is unknown, so it is the first to go
+				session.summaryStore.admit(f, args, 0);
+			}
+		}
+		else if ("F" == fields[0] && 2 == fields.size()) {
+			llvm::Function* f = functionNamed(fields[1]);
+			if (nullptr == f) {
+				return malformed();
+			}
+			finished.insert(f);
+		}
+		else if ("E" == fields[0]) {
+			llvm::DenseSet<llvm::Function*> functions;
+			for (size_t i = 1; i < fields.size(); i++) {
+				llvm::Function* f = functionNamed(fields[i]);
+				if (nullptr == f) {
+					return malformed();
+				}
+				functions.insert(f);
+			}
+			session.escalateTo(functions);
+			escalate(session, functions);
+		}
+		else if ("C" == fields[0] && 4 == fields.size()) {
+			int64_t analyses = 0;
+			int64_t visits = 0;
+			int64_t transfers = 0;
+			if (!parseInt(fields[1], analyses) || !parseInt(fields[2], visits)
+					|| !parseInt(fields[3], transfers)) {
+				return malformed();
+			}
+			session.stats.analyses = analyses;
+			session.stats.blockVisits = visits;
+			session.stats.transfers = transfers;
+		}
+		else {
+			return malformed();
+		}
+		valid += line.size() + 1;
+	}
+	if (0 == lineno) {
+		error = "is not a checkpoint";
+		return false;
+	}
+	return true;
+}
+
+
+void
+SessionCheckpoint::functionDone(OverflowerSession& session, llvm::Function& f) {
+	finished.insert(&f);
+	pendingFinished.push_back(&f);
+	if (std::chrono::steady_clock::now() - lastWrite >= interval) {
+		write(session);
+	}
+}
+
+
+void
+SessionCheckpoint::escalate(OverflowerSession& session,
+	const llvm::DenseSet<llvm::Function*>& functions) {
+	// the session dropped its reports and summaries, and the safety of the
+	// escalated functions' geps, so those are written again as they return
+	finished.clear();
+	pendingFinished.clear();
+	writtenSummaries.clear();
+	writtenReports.clear();
+	for (llvm::Function* f : functions) {
+		for (auto& i : llvm::instructions(*f)) {
+			writtenSafe.erase(&i);
+		}
+	}
+	escalated = true;
+	escalatedSet = functions;
+
+	if (out.is_open()) {
+		std::string record = "E";
+		for (llvm::Function* f : functions) {
+			record += "\t" + f->getName().str();
+		}
+		out << record << "\n";
+		out.flush();
+	}
+}
+
+
+void
+SessionCheckpoint::write(OverflowerSession& session) {
+	if (!out.is_open()) {
+		return;
+	}
+	BoundFacts::Scope scope(&session.facts);
+	std::string batch;
+
+	// Reports go first, so a summary on file implies that the reports found
+	// while computing it are too.
+	for (auto& contextErrors : session.potentialError) {
+		for (auto& potential : contextErrors.second) {
+			ErrReport* report = potential.second;
+			bool logged = session.errorLog.count(report);
+			auto written = writtenReports.find(report);
+			if (writtenReports.end() != written && (written->second || !logged)) {
+				continue;
+			}
+			writtenReports[report] = logged;
+			std::string record = "R";
+			appendContext(record, report->context);
+			record += "\t" + report->f->getName().str() + "\t"
+				+ std::to_string(numberOf(llvm::cast<llvm::Instruction>(potential.first)))
+				+ "\t" + std::to_string(report->lineno) + "\t"
+				+ std::to_string(report->buffersize);
+			appendRange(record, report->access);
+			record += logged ? "\t1\n" : "\t0\n";
+			batch += record;
+		}
+	}
+
+	for (auto& safe : session.provenSafe) {
+		auto written = writtenSafe.find(safe.first);
+		if (writtenSafe.end() != written && written->second == safe.second) {
+			continue;
+		}
+		writtenSafe[safe.first] = safe.second;
+		batch += "G\t" + safe.first->getFunction()->getName().str() + "\t"
+			+ std::to_string(numberOf(safe.first))
+			+ (safe.second ? "\t1\n" : "\t0\n");
+	}
+
+	for (auto& known : session.summaries) {
+		auto& written = writtenSummaries[known.first];
+		for (auto& summary : known.second) {
+			if (!written.insert(summary.first).second) {
+				continue;
+			}
+			std::string record = "S\t" + known.first->getName().str() + "\t"
+				+ std::to_string(summary.first.size());
+			for (auto& arg : summary.first) {
+				appendValue(record, arg);
+			}
+			appendValue(record, summary.second);
+			batch += record + "\n";
+		}
+	}
+
+	for (llvm::Function* f : pendingFinished) {
+		batch += "F\t" + f->getName().str() + "\n";
+	}
+	pendingFinished.clear();
+	batch += "C\t" + std::to_string(session.stats.analyses) + "\t"
+		+ std::to_string(session.stats.blockVisits) + "\t"
+		+ std::to_string(session.stats.transfers) + "\n";
+
+	out << batch;
+	out.flush();
+	lastWrite = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,172 @@
+//
+// Companion to the analysis for runtime checked builds. In functions built
+// with AddressSanitizer, the loads and stores overflower proved in bounds are
+// marked !nosanitize, so that the sanitizer skips exactly those and checks
+// the rest. In other functions, every load and store through an array
+// element whose index was not proven in bounds gets a check that traps when
+// the index leaves the array; proven accesses are left alone.
+//
+//   overflower in.bc -safe-map=in.safe
+//   opt -load lib/OverflowerPass.so -mem2reg -overflower-checks
+//       -overflower-safe-map=in.safe in.bc -o out.bc
+//
+// The map indexes instructions, so the checks must see the same IR that was
+// analyzed, i.e. after the same canonicalization, and the sanitizer must run
+// after them.
+//
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include <fstream>
+#include <string>
+
+#include "overflower.h"
+
+
+#define DEBUG_TYPE "overflower-checks"
+
+
+using namespace llvm;
+using std::string;
+
+
+STATISTIC(NumChecked, "Accesses given a runtime bounds check");
+STATISTIC(NumElided, "Checkable accesses proven safe by the analysis");
+STATISTIC(NumUnsanitized, "Proven accesses the sanitizer is told to skip");
+
+
+static cl::opt<string> safeMapPath{"overflower-safe-map",
+                                   cl::desc{"Accesses proven in bounds, as "
+                                            "written by overflower -safe-map"},
+                                   cl::value_desc{"filename"},
+                                   cl::init("")};
+
+static cl::opt<bool> checksStats{"overflower-checks-stats",
+                                 cl::desc{"Print how many accesses were "
+                                          "checked, elided and exempted "
+                                          "from the sanitizer to stderr"},
+                                 cl::init(false)};
+
+
+namespace {
+
+
+// Accesses whose address is a single index into a fixed size array can be
+// checked against the array length.
+static GetElementPtrInst*
+checkableAddress(Instruction& i) {
+  Value* ptr = nullptr;
+  if (auto* load = dyn_cast<LoadInst>(&i)) {
+    ptr = load->getPointerOperand();
+  }
+  else if (auto* store = dyn_cast<StoreInst>(&i)) {
+    ptr = store->getPointerOperand();
+  }
+  auto* gep = dyn_cast_or_null<GetElementPtrInst>(ptr);
+  if (nullptr == gep || 3 != gep->getNumOperands() ||
+      !gep->getSourceElementType()->isArrayTy()) {
+    return nullptr;
+  }
+  auto* base = dyn_cast<ConstantInt>(gep->getOperand(1));
+  return base && base->isZero() ? gep : nullptr;
+}
+
+
+static void
+insertCheck(Instruction& access, GetElementPtrInst& gep) {
+  Value* idx = gep.getOperand(2);
+  uint64_t length = gep.getSourceElementType()->getArrayNumElements();
+
+  // negative indices wrap around, so one unsigned compare covers both ends
+  IRBuilder<> builder(&access);
+  Value* outside =
+    builder.CreateICmpUGE(idx, ConstantInt::get(idx->getType(), length));
+  MDNode* unlikely =
+    MDBuilder(access.getContext()).createBranchWeights(1, 1 << 20);
+  auto* fail = SplitBlockAndInsertIfThen(outside, &access, true, unlikely);
+
+  Module* m = access.getModule();
+  IRBuilder<> failBuilder(fail);
+  failBuilder.CreateCall(Intrinsic::getDeclaration(m, Intrinsic::trap));
+}
+
+
+struct OverflowerChecks : public ModulePass {
+  static char ID;
+
+  OverflowerChecks() : ModulePass(ID) {}
+
+  bool
+  runOnModule(Module& m) override {
+    DenseSet<Instruction*> safe;
+    if (!safeMapPath.empty()) {
+      std::ifstream in(safeMapPath.getValue());
+      if (in.is_open()) {
+        safe = readSafeAccesses(m, in);
+      }
+      else {
+        errs() << "overflower: unable to read safe access map "
+               << safeMapPath << ", checking every access\n";
+      }
+    }
+
+    std::vector<std::pair<Instruction*, GetElementPtrInst*>> unproven;
+    unsigned elided = 0;
+    unsigned unsanitized = 0;
+    for (auto& f : m) {
+      // the sanitizer checks every access already, so proven ones are only
+      // exempted from it
+      if (f.hasFnAttribute(Attribute::SanitizeAddress)) {
+        for (auto& i : instructions(f)) {
+          if (safe.count(&i) && (isa<LoadInst>(i) || isa<StoreInst>(i))) {
+            i.setMetadata("nosanitize", MDNode::get(m.getContext(), None));
+            NumUnsanitized++;
+            unsanitized++;
+          }
+        }
+        continue;
+      }
+      for (auto& i : instructions(f)) {
+        GetElementPtrInst* gep = checkableAddress(i);
+        if (nullptr == gep) {
+          continue;
+        }
+        if (safe.count(&i)) {
+          NumElided++;
+          elided++;
+          continue;
+        }
+        unproven.push_back({&i, gep});
+      }
+    }
+
+    // checks split blocks, so insert them once the scan is done
+    for (auto& access : unproven) {
+      insertCheck(*access.first, *access.second);
+      NumChecked++;
+    }
+    if (checksStats) {
+      errs() << "overflower-checks: " << unproven.size() << " checked, "
+             << elided << " elided, " << unsanitized << " unsanitized\n";
+    }
+    return !unproven.empty() || unsanitized > 0;
+  }
+};
+
+
+} // end namespace
+
+
+char OverflowerChecks::ID = 0;
+
+static RegisterPass<OverflowerChecks> registerChecks{
+  "overflower-checks", "Bounds check accesses not proven safe", false, false};
@@ -0,0 +1,569 @@
+//
+// Compilation databases and the bitcode cache of overflower-scan, see
+// compiledb.h.
+//
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/YAMLParser.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cctype>
+#include <ctime>
+#include <fstream>
+#include <unordered_map>
+
+#include "canonicalize.h"
+#include "compiledb.h"
+
+#ifdef OVERFLOWER_COMPILEDB_H
+
+
+// bumped whenever the way entries are built changes
+static const char* cacheVersion = "overflower-scan 1";
+
+
+static std::string
+scalarOf(llvm::yaml::Node* node) {
+	auto* scalar = llvm::dyn_cast_or_null<llvm::yaml::ScalarNode>(node);
+	if (nullptr == scalar) {
+		return "";
+	}
+	llvm::SmallString<128> storage;
+	return scalar->getValue(storage).str();
+}
+
+
+// split a "command" as a POSIX shell would, i.e. what the compiler received
+static std::vector<std::string>
+splitCommand(const std::string& command) {
+	std::vector<std::string> words;
+	std::string word;
+	bool inWord = false;
+	char quote = 0;
+	for (size_t i = 0; i < command.size(); i++) {
+		char c = command[i];
+		if ('\'' == quote) {
+			if ('\'' == c) {
+				quote = 0;
+			}
+			else {
+				word += c;
+			}
+		}
+		else if ('"' == quote) {
+			if ('"' == c) {
+				quote = 0;
+			}
+			else if ('\\' == c && i + 1 < command.size()
+					&& std::string("\"\\$`").find(command[i + 1]) != std::string::npos) {
+				word += command[++i];
+			}
+			else {
+				word += c;
+			}
+		}
+		else if ('\'' == c || '"' == c) {
+			quote = c;
+			inWord = true;
+		}
+		else if ('\\' == c && i + 1 < command.size()) {
+			word += command[++i];
+			inWord = true;
+		}
+		else if (' ' == c || '\t' == c || '\n' == c) {
+			if (inWord) {
+				words.push_back(word);
+				word.clear();
+				inWord = false;
+			}
+		}
+		else {
+			word += c;
+			inWord = true;
+		}
+	}
+	if (inWord) {
+		words.push_back(word);
+	}
+	return words;
+}
+
+
+static std::string
+absolutePath(const std::string& directory, const std::string& path) {
+	if (llvm::sys::path::is_absolute(path)) {
+		return path;
+	}
+	llvm::SmallString<256> full(directory);
+	llvm::sys::path::append(full, path);
+	return full.str().str();
+}
+
+
+bool
+readCompilationDatabase(const std::string& path,
+	std::vector<CompileCommand>& commands, std::string& error) {
+	auto buffer = llvm::MemoryBuffer::getFile(path);
+	if (!buffer) {
+		error = buffer.getError().message();
+		return false;
+	}
+
+	// JSON is a subset of YAML
+	llvm::SourceMgr sm;
+	llvm::yaml::Stream stream((*buffer)->getBuffer(), sm);
+	auto document = stream.begin();
+	if (stream.end() == document) {
+		error = "empty compilation database";
+		return false;
+	}
+	auto* entries = llvm::dyn_cast_or_null<llvm::yaml::SequenceNode>(document->getRoot());
+	if (nullptr == entries) {
+		error = "expected an array of compile commands";
+		return false;
+	}
+
+	for (auto& entry : *entries) {
+		auto* fields = llvm::dyn_cast<llvm::yaml::MappingNode>(&entry);
+		if (nullptr == fields) {
+			error = "expected a compile command object";
+			return false;
+		}
+		CompileCommand command;
+		std::string shellCommand;
+		for (auto& field : *fields) {
+			std::string key = scalarOf(field.getKey());
+			llvm::yaml::Node* value = field.getValue();
+			if ("directory" == key) {
+				command.directory = scalarOf(value);
+			}
+			else if ("file" == key) {
+				command.file = scalarOf(value);
+			}
+			else if ("command" == key) {
+				shellCommand = scalarOf(value);
+			}
+			else if ("arguments" == key) {
+				auto* arguments = llvm::dyn_cast_or_null<llvm::yaml::SequenceNode>(value);
+				if (nullptr == arguments) {
+					error = "expected an array of arguments";
+					return false;
+				}
+				for (auto& argument : *arguments) {
+					command.arguments.push_back(scalarOf(&argument));
+				}
+			}
+			else {
+				// e.g. "output", which the cache chooses itself
+				value->skip();
+			}
+		}
+		if (command.arguments.empty()) {
+			command.arguments = splitCommand(shellCommand);
+		}
+		if (command.directory.empty() || command.file.empty()
+				|| command.arguments.empty()) {
+			error = "compile command without a directory, file or command";
+			return false;
+		}
+		command.file = absolutePath(command.directory, command.file);
+		commands.push_back(std::move(command));
+	}
+	if (stream.failed()) {
+		error = "malformed JSON";
+		return false;
+	}
+	return true;
+}
+
+
+static std::string
+digestOf(llvm::MD5& hash) {
+	llvm::MD5::MD5Result result;
+	hash.final(result);
+	llvm::SmallString<32> text;
+	llvm::MD5::stringifyResult(result, text);
+	return text.str().str();
+}
+
+
+static void
+update(llvm::MD5& hash, llvm::StringRef text) {
+	// terminated, so that consecutive strings cannot run into each other
+	hash.update(text);
+	hash.update(llvm::StringRef("", 1));
+}
+
+
+// arguments that choose outputs, dependency files or optimization, which
+// the cache sets itself
+static bool
+isOutputFlag(const std::string& argument, bool& takesValue) {
+	takesValue = "-o" == argument || "-MF" == argument
+		|| "-MT" == argument || "-MQ" == argument;
+	if (takesValue) {
+		return true;
+	}
+	static const char* exact[] = {"-c", "-S", "-E", "-emit-llvm", "-M", "-MM",
+		"-MD", "-MMD", "-MP", "-MG"};
+	for (const char* flag : exact) {
+		if (argument == flag) {
+			return true;
+		}
+	}
+	llvm::StringRef flag(argument);
+	if (flag.startswith("-O")) {
+		// but not -ObjC
+		return 2 == flag.size() || isdigit(flag[2]) || "-Os" == flag
+			|| "-Oz" == flag || "-Og" == flag || "-Ofast" == flag;
+	}
+	return (flag.startswith("-o") && !flag.startswith("-obj"))
+		|| flag.startswith("-MF") || flag.startswith("-MT") || flag.startswith("-MQ");
+}
+
+
+static std::vector<std::string>
+compilerArguments(const CompileCommand& command) {
+	std::vector<std::string> arguments;
+	for (size_t i = 1; i < command.arguments.size(); i++) {
+		bool takesValue = false;
+		if (isOutputFlag(command.arguments[i], takesValue)) {
+			i += takesValue;
+			continue;
+		}
+		arguments.push_back(command.arguments[i]);
+	}
+	return arguments;
+}
+
+
+// the prerequisites of a make rule written by -MD, i.e. the source and every
+// header it read
+static std::vector<std::string>
+readDependencies(const std::string& path, const std::string& directory) {
+	std::vector<std::string> files;
+	auto buffer = llvm::MemoryBuffer::getFile(path);
+	if (!buffer) {
+		return files;
+	}
+	llvm::StringRef rule = (*buffer)->getBuffer();
+	size_t colon = rule.find(": ");
+	if (llvm::StringRef::npos == colon) {
+		colon = rule.find(":\n");
+	}
+	if (llvm::StringRef::npos == colon) {
+		return files;
+	}
+
+	std::string file;
+	auto endFile = [&] () {
+		if (!file.empty()) {
+			files.push_back(absolutePath(directory, file));
+			file.clear();
+		}
+	};
+	for (size_t i = colon + 1; i < rule.size(); i++) {
+		char c = rule[i];
+		char next = i + 1 < rule.size() ? rule[i + 1] : 0;
+		if ('\\' == c && ('\n' == next || '\r' == next)) {
+			endFile();
+		}
+		else if ('\\' == c && (' ' == next || '#' == next)) {
+			file += next;
+			i++;
+		}
+		else if ('$' == c && '$' == next) {
+			file += c;
+			i++;
+		}
+		else if (' ' == c || '\t' == c || '\n' == c || '\r' == c) {
+			endFile();
+		}
+		else {
+			file += c;
+		}
+	}
+	endFile();
+	return files;
+}
+
+
+static bool
+writeManifest(const std::string& path, const std::vector<std::string>& files) {
+	std::ofstream out(path);
+	out << cacheVersion << "\n";
+	for (auto& file : files) {
+		out << file << "\n";
+	}
+	return bool(out);
+}
+
+
+static bool
+readManifest(const std::string& path, std::vector<std::string>& files) {
+	std::ifstream in(path);
+	std::string line;
+	if (!std::getline(in, line) || line != cacheVersion) {
+		return false;
+	}
+	while (std::getline(in, line)) {
+		files.push_back(line);
+	}
+	return !files.empty();
+}
+
+
+static bool
+fileDigest(const std::string& file, std::string& digest) {
+	auto buffer = llvm::MemoryBuffer::getFile(file);
+	if (!buffer) {
+		return false;
+	}
+	llvm::MD5 hash;
+	update(hash, (*buffer)->getBuffer());
+	digest = digestOf(hash);
+	return true;
+}
+
+
+// whether none of files changed since a compile started: those hashed in
+// before still have the same contents, and the others were last modified
+// before the second it started in
+static bool
+unchangedSince(const std::vector<std::string>& files,
+	const std::unordered_map<std::string, std::string>& before,
+	std::time_t started) {
+	for (auto& file : files) {
+		auto hashed = before.find(file);
+		if (before.end() != hashed) {
+			std::string digest;
+			if (!fileDigest(file, digest) || digest != hashed->second) {
+				return false;
+			}
+			continue;
+		}
+		llvm::sys::fs::file_status status;
+		if (llvm::sys::fs::status(file, status)
+				|| llvm::sys::toTimeT(status.getLastModificationTime()) >= started) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// write through a uniquely named file in the cache, then rename it into
+// place, so readers only ever see complete entries
+template<typename Write>
+static void
+writeEntry(const std::string& directory, const std::string& path, Write write) {
+	llvm::SmallString<256> temporary;
+	if (llvm::sys::fs::createUniqueFile(directory + "/tmp-%%%%%%%%", temporary)) {
+		return;
+	}
+	std::string written = temporary.str().str();
+	if (!write(written) || llvm::sys::fs::rename(written, path)) {
+		llvm::sys::fs::remove(written);
+	}
+}
+
+
+BitcodeCache::BitcodeCache(std::string directory, std::string clang,
+	std::vector<std::string> passes)
+	: directory(std::move(directory)), clang(std::move(clang)),
+	passes(std::move(passes)) {
+	llvm::MD5 hash;
+	update(hash, cacheVersion);
+	update(hash, LLVM_VERSION_STRING);
+	update(hash, this->clang);
+	// a reinstalled compiler keeps its path
+	llvm::sys::fs::file_status status;
+	if (!llvm::sys::fs::status(this->clang, status)) {
+		update(hash, std::to_string(status.getSize()));
+		update(hash, std::to_string(llvm::sys::toTimeT(status.getLastModificationTime())));
+	}
+	for (auto& pass : this->passes) {
+		update(hash, pass);
+	}
+	toolchain = digestOf(hash);
+}
+
+
+bool
+BitcodeCache::open(std::string& error) {
+	if (std::error_code failed = llvm::sys::fs::create_directories(directory)) {
+		error = failed.message();
+		return false;
+	}
+	return true;
+}
+
+
+std::string
+BitcodeCache::commandDigest(const CompileCommand& command) const {
+	llvm::MD5 hash;
+	update(hash, toolchain);
+	update(hash, command.directory);
+	update(hash, command.file);
+	for (auto& argument : compilerArguments(command)) {
+		update(hash, argument);
+	}
+	return digestOf(hash);
+}
+
+
+bool
+BitcodeCache::contentDigest(const std::string& commandKey,
+	const std::vector<std::string>& files, std::string& digest) const {
+	llvm::MD5 hash;
+	update(hash, commandKey);
+	for (auto& file : files) {
+		auto buffer = llvm::MemoryBuffer::getFile(file);
+		if (!buffer) {
+			return false;
+		}
+		update(hash, file);
+		update(hash, (*buffer)->getBuffer());
+	}
+	digest = digestOf(hash);
+	return true;
+}
+
+
+std::unique_ptr<llvm::Module>
+BitcodeCache::load(const CompileCommand& command, llvm::LLVMContext& context,
+	bool& cached, std::string& error) {
+	std::string commandKey = commandDigest(command);
+	std::vector<std::string> files;
+	std::string digest;
+	cached = readManifest(directory + "/" + commandKey + ".deps", files)
+		&& contentDigest(commandKey, files, digest);
+	if (cached) {
+		llvm::SMDiagnostic err;
+		auto module = llvm::parseIRFile(directory + "/" + digest + ".bc", err, context);
+		if (module) {
+			return module;
+		}
+		// evicted, or written by another version of LLVM
+		cached = false;
+	}
+	return compile(command, commandKey, files, context, error);
+}
+
+
+std::unique_ptr<llvm::Module>
+BitcodeCache::compile(const CompileCommand& command, const std::string& commandKey,
+	const std::vector<std::string>& previous, llvm::LLVMContext& context,
+	std::string& error) {
+	llvm::SmallString<256> bitcodePath;
+	llvm::SmallString<256> dependencyPath;
+	llvm::SmallString<256> outputPath;
+	if (llvm::sys::fs::createUniqueFile(directory + "/tmp-%%%%%%%%.bc", bitcodePath)
+			|| llvm::sys::fs::createUniqueFile(directory + "/tmp-%%%%%%%%.d", dependencyPath)
+			|| llvm::sys::fs::createUniqueFile(directory + "/tmp-%%%%%%%%.out", outputPath)) {
+		error = "cannot create temporary files in " + directory;
+		return nullptr;
+	}
+	auto removeTemporaries = [&] () {
+		llvm::sys::fs::remove(bitcodePath);
+		llvm::sys::fs::remove(dependencyPath);
+		llvm::sys::fs::remove(outputPath);
+	};
+
+	// As test/Makefile builds inputs: unoptimized with debug info for the
+	// lines of reports. Relative paths of the command are resolved against
+	// its directory by clang itself, as threads share the working directory.
+	std::vector<std::string> arguments{clang};
+	for (auto& argument : compilerArguments(command)) {
+		arguments.push_back(argument);
+	}
+	std::vector<std::string> added{"-c", "-emit-llvm", "-g",
+		"-working-directory", command.directory,
+		"-MD", "-MF", dependencyPath.str().str(),
+		"-o", bitcodePath.str().str()};
+	arguments.insert(arguments.end(), added.begin(), added.end());
+	std::vector<const char*> argv;
+	for (auto& argument : arguments) {
+		argv.push_back(argument.c_str());
+	}
+	argv.push_back(nullptr);
+
+	// The files the unit depended on when it was last compiled are hashed
+	// before clang reads them, so a file edited while it runs is noticed
+	// when the bitcode is cached.
+	std::time_t started = std::time(nullptr);
+	std::unordered_map<std::string, std::string> before;
+	for (auto& file : previous) {
+		std::string digest;
+		if (fileDigest(file, digest)) {
+			before[file] = digest;
+		}
+	}
+
+	llvm::StringRef output = outputPath;
+	const llvm::StringRef* redirects[] = {nullptr, &output, &output};
+	std::string message;
+	int status = llvm::sys::ExecuteAndWait(clang, argv.data(), nullptr,
+		redirects, 0, 0, &message);
+	if (0 != status) {
+		error = message.empty() ? "clang exited with " + std::to_string(status) : message;
+		auto diagnostics = llvm::MemoryBuffer::getFile(outputPath);
+		if (diagnostics && (*diagnostics)->getBufferSize()) {
+			error += "\n" + (*diagnostics)->getBuffer().rtrim().str();
+		}
+		removeTemporaries();
+		return nullptr;
+	}
+
+	llvm::SMDiagnostic err;
+	auto module = llvm::parseIRFile(bitcodePath, err, context);
+	std::vector<std::string> files = readDependencies(dependencyPath.str().str(),
+		command.directory);
+	removeTemporaries();
+	if (!module) {
+		error = err.getMessage().str();
+		return nullptr;
+	}
+	CanonicalizeStats sizes;
+	if (!canonicalize(*module, passes, sizes)) {
+		error = "unknown canonicalization pass";
+		return nullptr;
+	}
+
+	// without its dependencies, or if one of them changed while clang read
+	// it, the unit is simply compiled again next time
+	std::string digest;
+	if (files.empty() || !contentDigest(commandKey, files, digest)
+			|| !unchangedSince(files, before, started)) {
+		return module;
+	}
+	writeEntry(directory, directory + "/" + digest + ".bc",
+		[&module] (const std::string& path) {
+			std::error_code failed;
+			llvm::raw_fd_ostream out(path, failed, llvm::sys::fs::F_None);
+			if (failed) {
+				return false;
+			}
+			llvm::WriteBitcodeToFile(module.get(), out);
+			out.close();
+			return !out.has_error();
+		});
+	writeEntry(directory, directory + "/" + commandKey + ".deps",
+		[&files] (const std::string& path) {
+			return writeManifest(path, files);
+		});
+	return module;
+}
+
+
+#endif
@@ -0,0 +1,67 @@
+//
+// overflower-link, the global step between separate module analyses, see
+// modulesummary.h.
+//
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+#include <vector>
+
+#include "modulesummary.h"
+
+
+using namespace llvm;
+using std::string;
+
+
+static cl::OptionCategory linkCategory{"overflower-link options"};
+
+static cl::list<string> summaryPaths{cl::Positional,
+                                     cl::desc{"<Module summaries>"},
+                                     cl::value_desc{"summary filename"},
+                                     cl::OneOrMore,
+                                     cl::cat{linkCategory}};
+
+static cl::opt<bool> linkStats{"link-stats",
+                               cl::desc{"Print how many calls were linked, "
+                                        "resolved and rechecked to stderr"},
+                               cl::init(false),
+                               cl::cat{linkCategory}};
+
+
+int
+main(int argc, char** argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  llvm::PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj shutdown;
+  cl::HideUnrelatedOptions(linkCategory);
+  cl::ParseCommandLineOptions(argc, argv);
+
+  // Only the summaries are read, never the modules, so linking a program
+  // takes time in the number of its exports and cross module calls.
+  std::vector<string> paths(summaryPaths.begin(), summaryPaths.end());
+  LinkStats stats;
+  string error;
+  if (!linkModuleSummaries(paths, stats, error)) {
+    errs() << "Error linking module summaries: " << error << "\n";
+    return -1;
+  }
+
+  for (auto& name : stats.duplicates) {
+    errs() << "Warning: " << name << " is exported by several modules, "
+           << "linked to the first\n";
+  }
+  if (linkStats) {
+    errs() << "link: " << stats.modules << " modules, " << stats.exports
+           << " exports, " << stats.duplicates.size() << " duplicates, "
+           << stats.calls << " calls, " << stats.linked << " linked, "
+           << stats.resolved << " resolved, " << stats.rechecks
+           << " rechecks\n";
+  }
+  return 0;
+}
@@ -16,10 +16,16 @@
 #include "llvm/Analysis/ConstantFolding.h"
 
 #include <bitset>
+#include <chrono>
 #include <memory>
 #include <string>
 
+#include "canonicalize.h"
+#include "checkpoint.h"
+#include "modulesummary.h"
 #include "overflower.h"
+#include "ranges.h"
+#include "shards.h"
 
 
 using namespace llvm;
@@ -36,23 +42,312 @@ static cl::opt<string> inPath{cl::Positional,
                               cl::Required,
                               cl::cat{overflowerCategory}};
 
+static cl::opt<string> outPath{cl::Positional,
+                               cl::desc{"<Report output>"},
+                               cl::value_desc{"csv filename"},
+                               cl::init(""),
+                               cl::cat{overflowerCategory}};
 
-static auto
-computeBounds(llvm::Function& f, BoundSummary& summaries) {
-	analysis::ForwardDataflowAnalysis<BoundValue,
-			BoundTransfer,
-			BoundMeet> analysis;
-    std::vector<BoundValue> Args = {BoundValue()};
-	return analysis.computeForwardDataflow(summaries, f, Args);
+static cl::opt<string> safeMapPath{"safe-map",
+                                   cl::desc{"Write the accesses proven in "
+                                            "bounds, for -overflower-checks"},
+                                   cl::value_desc{"filename"},
+                                   cl::init(""),
+                                   cl::cat{overflowerCategory}};
+
+static cl::opt<string> rangeIndexPath{"range-index",
+                                      cl::desc{"Write the converged range of "
+                                               "every operand at every "
+                                               "instruction as a memory "
+                                               "mappable index"},
+                                      cl::value_desc{"filename"},
+                                      cl::init(""),
+                                      cl::cat{overflowerCategory}};
+
+static cl::opt<string> tracePath{"trace",
+                                 cl::desc{"Write analyses, block visits, "
+                                          "summary lookups and widening as "
+                                          "a Chrome trace"},
+                                 cl::value_desc{"filename"},
+                                 cl::init(""),
+                                 cl::cat{overflowerCategory}};
+
+static cl::opt<string> statsPath{"perf-stats",
+                                 cl::desc{"Write wall time, peak RSS and "
+                                          "fixpoint counters as CSV"},
+                                 cl::value_desc{"filename"},
+                                 cl::init(""),
+                                 cl::cat{overflowerCategory}};
+
+static cl::opt<unsigned> parallelBlocks{"parallel-blocks",
+                                        cl::desc{"Iterate independent CFG "
+                                                 "regions of functions with "
+                                                 "at least N blocks in "
+                                                 "parallel (0 disables)"},
+                                        cl::value_desc{"N"},
+                                        cl::init(0),
+                                        cl::cat{overflowerCategory}};
+
+static cl::list<string> canonicalizePasses{"canonicalize",
+                                           cl::desc{"Passes to run before "
+                                                    "the analysis, in order "
+                                                    "(default: mem2reg, "
+                                                    "empty for none)"},
+                                           cl::value_desc{"pass,..."},
+                                           cl::CommaSeparated,
+                                           cl::cat{overflowerCategory}};
+
+static cl::opt<bool> canonicalizeStats{"canonicalize-stats",
+                                       cl::desc{"Print how much "
+                                                "canonicalization shrank the "
+                                                "module to stderr"},
+                                       cl::init(false),
+                                       cl::cat{overflowerCategory}};
+
+static cl::opt<bool> accelerate{"accelerate-loops",
+                                 cl::desc{"Assign closed form ranges to "
+                                          "induction variables of counted "
+                                          "loops"},
+                                 cl::init(true),
+                                 cl::cat{overflowerCategory}};
+
+static cl::opt<bool> pruneIrrelevant{"prune-irrelevant",
+                                     cl::desc{"Skip functions that cannot "
+                                              "reach a bounds check"},
+                                     cl::init(true),
+                                     cl::cat{overflowerCategory}};
+
+static cl::opt<bool> cacheTransfers{"cache-transfers",
+                                    cl::desc{"Replay the transfers of pure "
+                                             "instructions whose operands "
+                                             "did not change"},
+                                    cl::init(false),
+                                    cl::cat{overflowerCategory}};
+
+static cl::opt<bool> pruneStates{"prune-states",
+                                 cl::desc{"Drop values from the states "
+                                          "where no check can read them"},
+                                 cl::init(true),
+                                 cl::cat{overflowerCategory}};
+
+static cl::opt<int> contextDepth{"context-depth",
+                                 cl::desc{"Follow calls in contexts of at "
+                                          "most <n> call sites, -1 for none"},
+                                 cl::value_desc{"n"},
+                                 cl::init(2),
+                                 cl::cat{overflowerCategory}};
+
+static cl::opt<bool> adaptiveContexts{"adaptive-contexts",
+                                      cl::desc{"Analyze without contexts "
+                                               "first, then follow calls only "
+                                               "on chains leading to "
+                                               "potential errors"},
+                                      cl::init(false),
+                                      cl::cat{overflowerCategory}};
+
+static cl::opt<unsigned> batchLanes{"batch-lanes",
+                                    cl::desc{"Analyze a callee for up to <n> "
+                                             "argument tuples from one block "
+                                             "in a single traversal"},
+                                    cl::value_desc{"n"},
+                                    cl::init(1),
+                                    cl::cat{overflowerCategory}};
+
+static cl::opt<bool> batchStats{"batch-stats",
+                                cl::desc{"Print how many worklist takes "
+                                         "-batch-lanes saved to stderr"},
+                                cl::init(false),
+                                cl::cat{overflowerCategory}};
+
+static cl::opt<Domain> domain{"domain",
+                              cl::desc{"Abstract domain of index ranges"},
+                              cl::values(
+                                clEnumValN(Domain::Bound, "bound",
+                                           "BoundValue intervals (default)"),
+                                clEnumValN(Domain::ConstantRange,
+                                           "constantrange",
+                                           "llvm::ConstantRange intervals"),
+                                clEnumValN(Domain::LazyValueInfo, "lvi",
+                                           "LazyValueInfo ranges, without "
+                                           "contexts"),
+                                clEnumValN(Domain::Product, "product",
+                                           "bound and constantrange in one "
+                                           "traversal, reporting accesses "
+                                           "neither proves")),
+                              cl::init(Domain::Bound),
+                              cl::cat{overflowerCategory}};
+
+static cl::opt<unsigned> summaryCacheMb{"summary-cache-mb",
+                                        cl::desc{"Keep callee summaries "
+                                                 "within <n> MB, evicting "
+                                                 "those cheapest to "
+                                                 "recompute (0 keeps all)"},
+                                        cl::value_desc{"n"},
+                                        cl::init(0),
+                                        cl::cat{overflowerCategory}};
+
+static cl::opt<string> summarySpillPath{"summary-spill",
+                                        cl::desc{"Spill evicted summaries to "
+                                                 "<file> instead of dropping "
+                                                 "them"},
+                                        cl::value_desc{"filename"},
+                                        cl::init(""),
+                                        cl::cat{overflowerCategory}};
+
+static cl::opt<bool> summaryCacheStats{"summary-cache-stats",
+                                       cl::desc{"Print hits, misses and "
+                                                "evictions of the store "
+                                                "bounded by "
+                                                "-summary-cache-mb to "
+                                                "stderr"},
+                                       cl::init(false),
+                                       cl::cat{overflowerCategory}};
+
+static cl::opt<string> checkpointPath{"checkpoint",
+                                      cl::desc{"Append completed functions, "
+                                               "summaries and reports to "
+                                               "<file> as the analysis goes"},
+                                      cl::value_desc{"filename"},
+                                      cl::init(""),
+                                      cl::cat{overflowerCategory}};
+
+static cl::opt<unsigned> checkpointInterval{"checkpoint-interval",
+                                            cl::desc{"Write a checkpoint at "
+                                                     "most every <n> seconds, "
+                                                     "between top level "
+                                                     "functions"},
+                                            cl::value_desc{"n"},
+                                            cl::init(60),
+                                            cl::cat{overflowerCategory}};
+
+static cl::opt<bool> resume{"resume",
+                            cl::desc{"Reload the -checkpoint file and only "
+                                     "analyze the functions it has not "
+                                     "finished"},
+                            cl::init(false),
+                            cl::cat{overflowerCategory}};
+
+static cl::opt<unsigned> workers{"workers",
+                                 cl::desc{"Analyze shards of the module in "
+                                          "<n> forked processes that share "
+                                          "callee summaries (1 analyzes in "
+                                          "process)"},
+                                 cl::value_desc{"n"},
+                                 cl::init(1),
+                                 cl::cat{overflowerCategory}};
+
+static cl::opt<unsigned> sharedSummaryMb{"shared-summary-mb",
+                                         cl::desc{"Size of the summary table "
+                                                  "shared by -workers"},
+                                         cl::value_desc{"n"},
+                                         cl::init(64),
+                                         cl::cat{overflowerCategory}};
+
+static cl::opt<string> moduleSummaryPath{"module-summary",
+                                         cl::desc{"Write the exported "
+                                                  "summaries and outgoing "
+                                                  "calls of the module to "
+                                                  "<file>, for "
+                                                  "overflower-link"},
+                                         cl::value_desc{"filename"},
+                                         cl::init(""),
+                                         cl::cat{overflowerCategory}};
+
+static cl::opt<string> importSummaryPath{"import-summary",
+                                         cl::desc{"Use the summaries and "
+                                                  "recheck the contexts "
+                                                  "overflower-link wrote to "
+                                                  "<file>"},
+                                         cl::value_desc{"filename"},
+                                         cl::init(""),
+                                         cl::cat{overflowerCategory}};
+
+static cl::opt<unsigned> memoryReport{"memory-report",
+                                      cl::desc{"Print peak memory by phase "
+                                               "and the N functions with the "
+                                               "largest footprint to stderr"},
+                                      cl::value_desc{"N"},
+                                      cl::init(0),
+                                      cl::cat{overflowerCategory}};
+
+static cl::opt<unsigned> threads{"threads",
+                                 cl::desc{"Worker threads for parallel "
+                                          "regions (default: all cores)"},
+                                 cl::value_desc{"N"},
+                                 cl::init(0),
+                                 cl::cat{overflowerCategory}};
+
+
+// Stats are written as a single CSV row so that the corpus runner in test/
+// can append them directly to its baseline:
+//   <wall ms>, <peak rss kb>, <analyses>, <block visits>, <transfers>
+static void
+printStats(std::ostream& out, double wallMs,
+           const analysis::FixpointStats& stats) {
+  out << wallMs << ", " << getPeakRSS() << ", " << stats.analyses << ", "
+      << stats.blockVisits << ", " << stats.transfers << "\n";
 }
 
-int
-main(int argc, char** argv) {
-  std::string fname;
-  if (2 < argc) {
-    fname = argv[2];
+
+static int
+writeStats(std::chrono::steady_clock::time_point start,
+           const analysis::FixpointStats& stats) {
+  if (!statsPath.empty()) {
+    std::chrono::duration<double, std::milli> wall =
+      std::chrono::steady_clock::now() - start;
+    std::ofstream sfs(statsPath.getValue());
+    if (!sfs.is_open()) {
+      errs() << "Error writing stats file: " << statsPath << "\n";
+      return -1;
+    }
+    printStats(sfs, wall.count(), stats);
   }
+  return 0;
+}
 
+
+// The alternative backends only produce reports and stats, for comparison
+// with the default domain by test/domains.sh.
+static int
+runRangeBackend(Module& m, std::chrono::steady_clock::time_point start) {
+  BoundOptions options;
+  options.accelerateLoops = accelerate;
+  options.pruneIrrelevant = pruneIrrelevant;
+  options.pruneStates     = pruneStates;
+  options.contextDepth    = contextDepth;
+
+  std::vector<ErrReport> reports;
+  analysis::FixpointStats lviStats;
+  RangeSession session(options);
+  ProductSession product(options);
+  if (Domain::LazyValueInfo == domain) {
+    reports = lazyValueReports(m, lviStats);
+  }
+  else if (Domain::Product == domain) {
+    product.analyzeModule(m);
+    reports = product.getReports();
+  }
+  else {
+    session.analyzeModule(m);
+    reports = session.getReports();
+  }
+
+  std::ofstream fs(outPath.getValue());
+  std::ostream& out = fs.is_open() ? fs : std::cout;
+  for (auto& report : reports) {
+    printReport(out, report);
+  }
+  fs.close();
+
+  return writeStats(start, Domain::LazyValueInfo == domain
+                           ? lviStats
+                           : Domain::Product == domain ? product.getStats()
+                                                       : session.getStats());
+}
+
+
+int
+main(int argc, char** argv) {
   // This boilerplate provides convenient stack traces and clean LLVM exit
   // handling. It also initializes the built in support for convenient
   // command line option handling.
@@ -61,6 +356,7 @@ main(int argc, char** argv) {
   llvm_shutdown_obj shutdown;
   cl::HideUnrelatedOptions(overflowerCategory);
   cl::ParseCommandLineOptions(argc, argv);
+  auto start = std::chrono::steady_clock::now();
 
   // Construct an IR file from the filename passed on the command line.
   SMDiagnostic err;
@@ -73,25 +369,212 @@ main(int argc, char** argv) {
     return -1;
   }
 
-  BoundSummary summaries;
+  MemoryProfile profile;
+  MemoryProfile* memory = memoryReport ? &profile : nullptr;
+  if (memory) {
+    memory->recordPhase("parse");
+  }
 
-  for (auto& f : *module) {
-    if (f.isDeclaration()) {
-      continue;
+  // Without an explicit pipeline, promote allocas so that raw -O0 bitcode
+  // can be analyzed directly. This is a no-op on inputs that ran mem2reg.
+  std::vector<string> passes(canonicalizePasses.begin(),
+                             canonicalizePasses.end());
+  if (canonicalizePasses.getNumOccurrences() == 0) {
+    passes = {"mem2reg"};
+  }
+  CanonicalizeStats sizes;
+  if (!canonicalize(*module, passes, sizes)) {
+    return -1;
+  }
+  if (canonicalizeStats) {
+    errs() << "canonicalize: " << sizes.instsBefore << " -> "
+           << sizes.instsAfter << " instructions, " << sizes.blocksBefore
+           << " -> " << sizes.blocksAfter << " blocks\n";
+  }
+  if (memory) {
+    memory->recordPhase("canonicalize");
+  }
+
+  if (Domain::Bound != domain) {
+    return runRangeBackend(*module, start);
+  }
+
+  BoundOptions options;
+  options.parallelBlocks   = parallelBlocks;
+  options.threads          = threads;
+  options.accelerateLoops  = accelerate;
+  options.pruneIrrelevant  = pruneIrrelevant;
+  options.cacheTransfers   = cacheTransfers;
+  // the range index records the operands of every instruction
+  options.pruneStates      = pruneStates && rangeIndexPath.empty();
+  options.contextDepth     = contextDepth;
+  options.adaptiveContexts = adaptiveContexts;
+  options.batchLanes       = batchLanes;
+  options.summaryCacheMb   = summaryCacheMb;
+
+  if (workers > 1 && (!checkpointPath.empty() || !tracePath.empty()
+                      || !rangeIndexPath.empty() || memoryReport
+                      || !summarySpillPath.empty())) {
+    errs() << "-workers cannot be combined with -checkpoint, -trace, "
+              "-range-index, -memory-report or -summary-spill\n";
+    return -1;
+  }
+  bool separate = !moduleSummaryPath.empty() || !importSummaryPath.empty();
+  if (separate && (workers > 1 || !checkpointPath.empty()
+                   || adaptiveContexts)) {
+    errs() << "-module-summary and -import-summary cannot be combined with "
+              "-workers, -checkpoint or -adaptive-contexts\n";
+    return -1;
+  }
+
+  OverflowerSession session(options);
+  if (!summarySpillPath.empty() &&
+      !session.spillSummaries(summarySpillPath.getValue())) {
+    errs() << "Error writing summary spill file: " << summarySpillPath << "\n";
+    return -1;
+  }
+  analysis::FixpointTrace trace;
+  if (!tracePath.empty()) {
+    session.enableTrace(&trace);
+  }
+  ModuleLinkage linkage;
+  if (!importSummaryPath.empty()) {
+    string error;
+    if (!linkage.readImports(importSummaryPath.getValue(), *module, session,
+                            error)) {
+      errs() << "Error reading imports: " << importSummaryPath << " "
+             << error << "\n";
+      return -1;
+    }
+  }
+  if (separate) {
+    session.enableExternalCalls(&linkage);
+  }
+  if (resume && checkpointPath.empty()) {
+    errs() << "-resume needs the -checkpoint file to resume from\n";
+    return -1;
+  }
+  // checkpoints hold summaries and reports, not the states at every
+  // instruction these are made of, so the functions they finished would be
+  // missing
+  if (resume && (!rangeIndexPath.empty() || memoryReport)) {
+    errs() << "-resume cannot be combined with -range-index or "
+              "-memory-report\n";
+    return -1;
+  }
+  SessionCheckpoint checkpoint(checkpointInterval);
+  if (resume) {
+    string error;
+    if (!checkpoint.resume(checkpointPath.getValue(), *module, session,
+                           error)) {
+      errs() << "Error resuming from checkpoint: " << checkpointPath << " "
+             << error << "\n";
+      return -1;
+    }
+    session.enableCheckpoint(&checkpoint);
+  }
+  else if (!checkpointPath.empty()) {
+    if (!checkpoint.create(checkpointPath.getValue(), *module)) {
+      errs() << "Error writing checkpoint: " << checkpointPath << "\n";
+      return -1;
+    }
+    session.enableCheckpoint(&checkpoint);
+  }
+  RangeIndexWriter rangeIndex;
+  ShardResults shardResults;
+  if (workers > 1) {
+    ShardOptions shards;
+    shards.workers            = workers;
+    shards.tableMb            = sharedSummaryMb;
+    shards.checkpointInterval = checkpointInterval;
+    string error;
+    if (!analyzeSharded(*module, options, shards, session, shardResults,
+                        error)) {
+      errs() << "Error starting workers: " << error << "\n";
+      return -1;
+    }
+    for (unsigned shard : shardResults.failed) {
+      errs() << "Worker " << shard << " did not finish, the functions of its "
+                "shard after its last checkpoint were not analyzed\n";
     }
-    auto results = computeBounds(f, summaries);
+  }
+  else {
+    session.analyzeModule(*module, memory,
+                          rangeIndexPath.empty() ? nullptr : &rangeIndex);
+    linkage.recheck(session);
+  }
+  if (memory) {
+    memory->recordPhase("analysis");
+  }
+  if (summaryCacheStats && workers > 1) {
+    auto& counters = shardResults.summaries;
+    errs() << "shared summaries: " << counters.published << " published, "
+           << counters.hits << " hits, " << counters.dropped << " dropped\n";
+  }
+  if (batchStats) {
+    auto& stats = session.getStats();
+    errs() << "batched calls: " << stats.takesSaved
+           << " worklist takes saved of " << stats.blockVisits
+           << " block visits\n";
+  }
+  if (summaryCacheStats) {
+    auto& counters = session.getSummaryCounters();
+    errs() << "summary cache: " << counters.hits << " hits, "
+           << counters.misses << " misses, " << counters.evictions
+           << " evictions, " << counters.spills << " spilled, "
+           << counters.reloads << " reloaded, peak "
+           << counters.peakBytes / 1024 << " kb\n";
   }
 
-  std::ofstream fs(fname);
+  std::ofstream fs(outPath.getValue());
   if (fs.is_open()) {
-    printErrors(fs);
+    session.printReports(fs);
     fs.close();
   }
   else {
-    printErrors(std::cout);
+    session.printReports(std::cout);
   }
 
-  clearReports();
+  if (!rangeIndexPath.empty()) {
+    std::ofstream ifs(rangeIndexPath.getValue(), std::ios::binary);
+    if (!ifs.is_open()) {
+      errs() << "Error writing range index: " << rangeIndexPath << "\n";
+      return -1;
+    }
+    rangeIndex.write(ifs);
+  }
 
-  return 0;
+  if (!tracePath.empty()) {
+    std::ofstream tfs(tracePath.getValue());
+    if (!tfs.is_open()) {
+      errs() << "Error writing trace: " << tracePath << "\n";
+      return -1;
+    }
+    trace.write(tfs);
+  }
+
+  if (!moduleSummaryPath.empty() &&
+      !linkage.writeSummary(moduleSummaryPath.getValue(), *module, session)) {
+    errs() << "Error writing module summary: " << moduleSummaryPath << "\n";
+    return -1;
+  }
+
+  if (!safeMapPath.empty()) {
+    std::ofstream mfs(safeMapPath.getValue());
+    if (!mfs.is_open()) {
+      errs() << "Error writing safe access map: " << safeMapPath << "\n";
+      return -1;
+    }
+    session.printSafeAccesses(*module, mfs);
+  }
+
+  session.clear();
+
+  if (memory) {
+    memory->recordPhase("report");
+    memory->print(std::cerr, memoryReport);
+  }
+
+  int written = writeStats(start, session.getStats());
+  return shardResults.failed.empty() ? written : -1;
 }
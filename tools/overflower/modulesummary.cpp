@@ -0,0 +1,413 @@
+//
+// Module summaries and the link step, see modulesummary.h.
+//
+
+#include "modulesummary.h"
+#include "records.h"
+
+#include "llvm/Support/MathExtras.h"
+
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+
+
+// Records are tab separated, with a tag first. Summaries hold
+//   overflower summary 1, <module>                       (header)
+//   X <function>                     the module exports a definition
+//   S <function> <argument count> <argument>... <return>
+//   U <caller> <context> <callee> <argument count> <argument>...
+// and imports
+//   overflower imports 1, <module>                       (header)
+//   I <callee> <argument count> <argument>... <return>
+//   K <function> <context> <argument count> <argument>...
+// where U is a call to a declared function in the caller's context, I the
+// summary of such a callee and K an exported function to analyze in a
+// context of another module. Values take three fields, <lower>:<upper> or
+// undef, the bits of their entropy and their type, - for none. Types are
+// written out, since the modules do not share them. The link step matches
+// arguments by range and type only, as sessions tell them apart by range.
+static const char* const summaryHeader = "overflower summary 1";
+static const char* const importsHeader = "overflower imports 1";
+
+
+static void
+appendValue(std::string& record, const BoundValue& value) {
+	appendRange(record, value.range());
+	record += "\t" + std::to_string(llvm::FloatToBits(value.entropy()));
+	record += "\t" + (value.type() ? typeName(value.type()) : "-");
+}
+
+
+static void
+appendArgs(std::string& record, const std::vector<BoundValue>& args) {
+	record += "\t" + std::to_string(args.size());
+	for (auto& arg : args) {
+		appendValue(record, arg);
+	}
+}
+
+
+static bool
+isExported(llvm::Function& f) {
+	return !f.isDeclaration() && !f.hasLocalLinkage();
+}
+
+
+bool
+ModuleLinkage::resolve(llvm::CallInst& call, const Args& args,
+	const std::vector<unsigned>& context, BoundValue& result) {
+	llvm::Function* callee = call.getCalledFunction();
+	std::string record = "U\t" + call.getFunction()->getName().str();
+	appendContext(record, context);
+	record += "\t" + callee->getName().str();
+	appendArgs(record, args);
+	auto made = called.insert({{&call, context}, calls.size()});
+	if (made.second) {
+		calls.push_back(record);
+	}
+	else {
+		calls[made.first->second] = record;
+	}
+
+	auto known = imported.find(callee);
+	if (imported.end() == known) {
+		return false;
+	}
+	auto summary = known->second.find(args);
+	if (known->second.end() == summary) {
+		return false;
+	}
+	result = summary->second;
+	return true;
+}
+
+
+bool
+ModuleLinkage::writeSummary(const std::string& path, llvm::Module& m,
+	OverflowerSession& session) const {
+	std::ofstream out(path, std::ios::out | std::ios::trunc);
+	if (!out.is_open()) {
+		return false;
+	}
+	BoundFacts::Scope scope(&session.getFacts());
+	out << summaryHeader << "\t" << m.getModuleIdentifier() << "\n";
+
+	BoundSummary& summaries = session.getSummaries();
+	for (auto& f : m) {
+		if (!isExported(f)) {
+			continue;
+		}
+		out << "X\t" << f.getName().str() << "\n";
+		auto known = summaries.find(&f);
+		if (summaries.end() == known) {
+			continue;
+		}
+		for (auto& summary : known->second) {
+			std::string record = "S\t" + f.getName().str();
+			appendArgs(record, summary.first);
+			appendValue(record, summary.second);
+			out << record << "\n";
+		}
+	}
+	std::unordered_set<std::string> written;
+	for (auto& record : calls) {
+		if (written.insert(record).second) {
+			out << record << "\n";
+		}
+	}
+	out.flush();
+	return out.good();
+}
+
+
+bool
+ModuleLinkage::readImports(const std::string& path, llvm::Module& m,
+	OverflowerSession& session, std::string& error) {
+	BoundFacts::Scope scope(&session.getFacts());
+	std::ifstream in(path);
+	if (!in.is_open()) {
+		error = "cannot be read";
+		return false;
+	}
+	std::unordered_map<std::string, llvm::Type*> types = moduleTypes(m);
+	// reads the value starting at fields[at]
+	auto value = [&] (const std::vector<std::string>& fields, size_t at,
+			BoundValue& read) {
+		BoundFact fact;
+		int64_t bits = 0;
+		if (at + 3 > fields.size() || !parseRange(fields[at], fact.range)
+				|| !parseInt(fields[at + 1], bits)) {
+			return false;
+		}
+		fact.range_entropy = llvm::BitsToFloat(bits);
+		// types the module does not have are dropped from their values
+		auto type = types.find(fields[at + 2]);
+		fact.boundType = types.end() != type ? type->second : nullptr;
+		read = BoundValue(fact);
+		return true;
+	};
+	// reads the count of arguments at fields[at] and the values after it
+	auto arguments = [&] (const std::vector<std::string>& fields, size_t at,
+			Args& read) {
+		int64_t count = 0;
+		if (at >= fields.size() || !parseInt(fields[at], count) || count < 0) {
+			return false;
+		}
+		read.resize(count);
+		for (int64_t a = 0; a < count; a++) {
+			if (!value(fields, at + 1 + 3 * a, read[a])) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	std::string line;
+	size_t lineno = 0;
+	while (std::getline(in, line)) {
+		lineno++;
+		auto fields = splitFields(line);
+		auto malformed = [&] () {
+			error = "record " + std::to_string(lineno) + " is malformed";
+			return false;
+		};
+		auto stale = [&] (const std::string& name) {
+			error = "were written for another module, this one lacks " + name;
+			return false;
+		};
+
+		if (1 == lineno) {
+			if (fields.size() != 2 || fields[0] != importsHeader) {
+				error = "are not module imports";
+				return false;
+			}
+		}
+		else if ("I" == fields[0] && fields.size() >= 3) {
+			llvm::Function* callee = m.getFunction(fields[1]);
+			if (nullptr == callee || !callee->isDeclaration()) {
+				return stale(fields[1]);
+			}
+			Args args;
+			BoundValue ret;
+			if (!arguments(fields, 2, args)
+					|| fields.size() != 3 + 3 * (args.size() + 1)
+					|| !value(fields, 3 + 3 * args.size(), ret)) {
+				return malformed();
+			}
+			imported[callee][args] = ret;
+		}
+		else if ("K" == fields[0] && fields.size() >= 4) {
+			llvm::Function* f = m.getFunction(fields[1]);
+			if (nullptr == f || f->isDeclaration()) {
+				return stale(fields[1]);
+			}
+			Recheck recheck{f, {}, {}};
+			if (!parseContext(fields[2], recheck.context)
+					|| !arguments(fields, 3, recheck.args)
+					|| fields.size() != 4 + 3 * recheck.args.size()) {
+				return malformed();
+			}
+			rechecks.push_back(recheck);
+		}
+		else {
+			return malformed();
+		}
+	}
+	if (0 == lineno) {
+		error = "are not module imports";
+		return false;
+	}
+	return true;
+}
+
+
+void
+ModuleLinkage::recheck(OverflowerSession& session) const {
+	BoundFacts::Scope scope(&session.getFacts());
+	BoundSummary& summaries = session.getSummaries();
+	for (auto& recheck : rechecks) {
+		// a whole program analysis only checks a callee in the first context
+		// that calls it with these arguments and takes its summary in the rest
+		auto known = summaries.find(recheck.f);
+		if (summaries.end() != known && known->second.count(recheck.args)) {
+			continue;
+		}
+		session.analyzeInContext(*recheck.f, recheck.args, recheck.context);
+	}
+}
+
+
+namespace {
+
+
+// what the link step knows of a function some module exports
+struct Export {
+	size_t module;
+	// return value fields by the keyFields of their arguments
+	std::unordered_map<std::string, std::string> summaries;
+};
+
+
+}
+
+
+// the fields from begin to end of a record, joined as they were
+static std::string
+joinFields(const std::vector<std::string>& fields, size_t begin, size_t end) {
+	std::string joined;
+	for (size_t i = begin; i < end; i++) {
+		joined += (i > begin ? "\t" : "") + fields[i];
+	}
+	return joined;
+}
+
+
+// the ranges and types of the values from begin to end of a record, which is
+// how the link step matches arguments; their entropy is left out, it hardly
+// ever comes out the same in two modules
+static std::string
+keyFields(const std::vector<std::string>& fields, size_t begin, size_t end) {
+	std::string joined;
+	for (size_t i = begin; i + 3 <= end; i += 3) {
+		joined += (i > begin ? "\t" : "") + fields[i] + "\t" + fields[i + 2];
+	}
+	return joined;
+}
+
+
+// the fields a count of values at fields[at] spans, or 0 if they are missing
+static size_t
+valueFields(const std::vector<std::string>& fields, size_t at) {
+	int64_t count = 0;
+	if (at >= fields.size() || !parseInt(fields[at], count) || count < 0
+			|| fields.size() < at + 1 + 3 * size_t(count)) {
+		return 0;
+	}
+	return 1 + 3 * size_t(count);
+}
+
+
+bool
+linkModuleSummaries(const std::vector<std::string>& paths, LinkStats& stats,
+	std::string& error) {
+	std::unordered_map<std::string, Export> exports;
+	// the calls of each module, as the fields of their records
+	std::vector<std::vector<std::vector<std::string> > > calls(paths.size());
+	std::vector<std::string> modules(paths.size());
+
+	for (size_t module = 0; module < paths.size(); module++) {
+		std::ifstream in(paths[module]);
+		if (!in.is_open()) {
+			error = paths[module] + " cannot be read";
+			return false;
+		}
+		std::string line;
+		size_t lineno = 0;
+		while (std::getline(in, line)) {
+			lineno++;
+			auto fields = splitFields(line);
+			auto malformed = [&] () {
+				error = paths[module] + ": record " + std::to_string(lineno)
+					+ " is malformed";
+				return false;
+			};
+
+			if (1 == lineno) {
+				if (fields.size() != 2 || fields[0] != summaryHeader) {
+					error = paths[module] + " is not a module summary";
+					return false;
+				}
+				modules[module] = fields[1];
+			}
+			else if ("X" == fields[0] && 2 == fields.size()) {
+				// the first module to export a function provides it
+				if (exports.insert({fields[1], {module, {}}}).second) {
+					stats.exports++;
+				}
+				else {
+					stats.duplicates.push_back(fields[1]);
+				}
+			}
+			else if ("S" == fields[0] && fields.size() >= 3) {
+				size_t args = valueFields(fields, 2);
+				if (0 == args || fields.size() != 2 + args + 3) {
+					return malformed();
+				}
+				auto exported = exports.find(fields[1]);
+				if (exports.end() == exported) {
+					return malformed();
+				}
+				if (exported->second.module == module) {
+					exported->second.summaries.insert({
+						keyFields(fields, 3, 2 + args),
+						joinFields(fields, 2 + args, fields.size())});
+				}
+			}
+			else if ("U" == fields[0] && fields.size() >= 5) {
+				size_t args = valueFields(fields, 4);
+				if (0 == args || fields.size() != 4 + args) {
+					return malformed();
+				}
+				calls[module].push_back(std::move(fields));
+				stats.calls++;
+			}
+			else {
+				return malformed();
+			}
+		}
+		if (0 == lineno) {
+			error = paths[module] + " is not a module summary";
+			return false;
+		}
+	}
+	stats.modules = paths.size();
+
+	// Every call into a linked module takes the callee's summary for its
+	// arguments, if there is one, and has the callee analyzed in the call's
+	// context. That checks its geps as a whole program analysis would, and
+	// gives its module the summary to export in the next round, if any.
+	std::vector<std::vector<std::string> > imports(paths.size());
+	std::vector<std::unordered_set<std::string> > written(paths.size());
+	for (size_t module = 0; module < paths.size(); module++) {
+		for (auto& call : calls[module]) {
+			auto exported = exports.find(call[3]);
+			if (exports.end() == exported) {
+				continue;
+			}
+			stats.linked++;
+			std::string args = joinFields(call, 4, call.size());
+			auto summary = exported->second.summaries.find(
+				keyFields(call, 5, call.size()));
+			if (exported->second.summaries.end() != summary) {
+				stats.resolved++;
+				std::string record = "I\t" + call[3] + "\t" + args + "\t"
+					+ summary->second;
+				if (written[module].insert(record).second) {
+					imports[module].push_back(record);
+				}
+			}
+			size_t callee = exported->second.module;
+			std::string record = "K\t" + call[3] + "\t" + call[2] + "\t" + args;
+			if (written[callee].insert(record).second) {
+				imports[callee].push_back(record);
+				stats.rechecks++;
+			}
+		}
+	}
+
+	for (size_t module = 0; module < paths.size(); module++) {
+		std::string path = paths[module] + ".imports";
+		std::ofstream out(path, std::ios::out | std::ios::trunc);
+		out << importsHeader << "\t" << modules[module] << "\n";
+		for (auto& record : imports[module]) {
+			out << record << "\n";
+		}
+		out.flush();
+		if (!out.good()) {
+			error = path + " cannot be written";
+			return false;
+		}
+	}
+	return true;
+}
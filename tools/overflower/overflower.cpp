@@ -3,34 +3,220 @@
 //
 
 #include "overflower.h"
+#include "RangeIndex.h"
+#include "checkpoint.h"
+#include "ranges.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
+#include <cstring>
+#include <mutex>
 #include <random>
+#include <sstream>
 
 #ifdef OVERFLOWER_OVERFLOWER_H
 
-static std::random_device rd;
-static std::mt19937 gen(rd());
-static std::uniform_real_distribution<float> rando(0, 1);
+// per thread, so that concurrent sessions never share a generator
+static thread_local std::random_device rd;
+static thread_local std::mt19937 gen(rd());
+static thread_local std::uniform_real_distribution<float> rando(0, 1);
 
-void widen (BoundValue& bv) {
+size_t
+BoundFactHash::operator () (const BoundFact& fact) const {
+	if (!fact.range) {
+		return llvm::hash_combine(fact.boundType);
+	}
+	return llvm::hash_combine(fact.range->first, fact.range->second,
+		fact.boundType);
+}
+
+
+size_t
+TransferKeyHash::operator () (const TransferKey& key) const {
+	return llvm::hash_combine(key.opcode, key.type, key.lhs, key.rhs);
+}
+
+
+size_t
+MeetKeyHash::operator () (const MeetKey& key) const {
+	return llvm::hash_combine(key.id1, key.entropy1, key.id2, key.entropy2);
+}
+
+
+static BoundFacts*&
+currentFacts() {
+	static thread_local BoundFacts* facts = nullptr;
+	return facts;
+}
+
+
+BoundFacts::Scope::Scope(BoundFacts* facts) : previous(currentFacts()) {
+	currentFacts() = facts;
+}
+
+
+BoundFacts::Scope::~Scope() {
+	currentFacts() = previous;
+}
+
+
+BoundFacts*
+BoundFacts::current() {
+	return currentFacts();
+}
+
+
+BoundFacts::BoundFacts() {
+	initialize();
+}
+
+
+void
+BoundFacts::initialize() {
+	// in the order of Reserved
+	intern(BoundFact());
+	BoundFact everything;
+	everything.range = BOUND({NEGINF, INF});
+	intern(everything);
+	BoundFact empty;
+	empty.range = BOUND({NEGINF, NEGINF});
+	intern(empty);
+	BoundFact tombstone;
+	tombstone.range = BOUND({INF, NEGINF});
+	intern(tombstone);
+}
+
+
+unsigned
+BoundFacts::intern(const BoundFact& fact) {
+	BoundFact key = fact;
+	key.range_entropy = 0.0;
+	std::lock_guard<std::mutex> guard(lock);
+	auto found = ids.find(key);
+	if (ids.end() != found) {
+		return found->second;
+	}
+	if (count == chunkCount << chunkBits) {
+		if (!full) {
+			full = true;
+			llvm::errs() << "Warning: more than " << count << " distinct bounds, "
+				<< "new ones are taken as -inf:inf\n";
+		}
+		return top;
+	}
+	unsigned id = count++;
+	auto& chunk = chunks[id >> chunkBits];
+	if (nullptr == chunk) {
+		chunk.reset(new BoundFact[1 << chunkBits]);
+	}
+	chunk[id & ((1 << chunkBits) - 1)] = key;
+	ids.insert({key, id});
+	return id;
+}
+
+
+size_t
+BoundFacts::size() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return count;
+}
+
+
+void
+BoundFacts::clear() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (auto& chunk : chunks) {
+			chunk.reset();
+		}
+		count = 0;
+		full = false;
+		ids.clear();
+		meets.clear();
+	}
+	initialize();
+}
+
+
+// the table of the session using values on this thread
+static BoundFacts&
+boundFacts() {
+	BoundFacts* facts = BoundFacts::current();
+	if (nullptr == facts) {
+		llvm::report_fatal_error("overflower: bounds used outside of a session");
+	}
+	return *facts;
+}
+
+
+static void
+printBound(std::ostream& out, const BOUND& range) {
+	if (range->first <= NEGINF) {
+		out << "-inf:";
+	}
+	else {
+		out << range->first << ":";
+	}
+	if (range->second >= INF) {
+		out << "inf";
+	}
+	else {
+		out << range->second;
+	}
+}
+
+
+static std::string
+describeBound(const BOUND& range) {
+	std::ostringstream out;
+	printBound(out, range);
+	return out.str();
+}
+
+
+static void
+traceWiden(const BOUND& before, const BoundFact& after) {
+	if (auto* trace = analysis::FixpointTrace::active()) {
+		trace->instant("widen", after.range->first <= NEGINF && after.range->second >= INF
+				? "widen to top" : "widen",
+			analysis::TraceArgs()
+				.add("from", describeBound(before))
+				.add("to", describeBound(after.range)));
+	}
+}
+
+
+void widen (BoundFact& bv) {
 	assert(false == isnan(bv.range_entropy));
 
-	if (!bv.isInf()) {
+	if (!(bv.range && NEGINF == bv.range->first && INF == bv.range->second)) {
 		unsigned interval = bv.range->second - bv.range->first+1;
 		unsigned milestone = interval / 256;
 		if ((1 - bv.range_entropy) * interval > INF / 4) { // set fairly high threshold for moving to top
 			// bound the real interval
+			BOUND before = bv.range;
 			bv.range = BOUND({NEGINF, INF});
+			traceWiden(before, bv);
 		}
 		// we want to encourage range approximation, for faster convergence
 		// set ad hoc threshold of 0.5 entropy
 		else if (bv.range_entropy < 0.5) {
 			if (milestone >= 1) {
+				BOUND before = bv.range;
 				double growth = std::log(interval/2);
 				for (size_t i = 0; i < milestone; i++) {
 					bv.range->second += growth;
 					bv.range->first -= growth;
 				}
 				bv.range_entropy *= 1.0 + (milestone * growth / interval);
+				traceWiden(before, bv);
 			}
 		}
 	}
@@ -54,10 +240,10 @@ std::pair<float, BOUND> BoundValue::predicateBound(int64_t value,
 	float potential_entropy = rando(gen) / 2;
 	BOUND fbound;
 
-	if (prevState != nullptr && prevState->range) {
-		lower = prevState->range->first;
-		upper = prevState->range->second;
-		potential_entropy += prevState->range_entropy;
+	if (prevState != nullptr && prevState->hasRange()) {
+		lower = prevState->range()->first;
+		upper = prevState->range()->second;
+		potential_entropy += prevState->entropy();
 		potential_entropy /= 2;
 	}
 
@@ -66,7 +252,7 @@ std::pair<float, BOUND> BoundValue::predicateBound(int64_t value,
 		case llvm::CmpInst::FCMP_UEQ:
 		case llvm::CmpInst::ICMP_EQ:
 			fbound = BOUND({value, value});
-			potential_entropy = range_entropy;
+			potential_entropy = entropy();
 			break;
 
 			// for ranges with undefined upper or lower bound, assign noise to simulate
@@ -127,109 +313,170 @@ std::pair<float, BOUND> BoundValue::predicateBound(int64_t value,
 }
 
 
+BoundValue::BoundValue(const BoundFact& fact) {
+	assign(fact);
+}
+
 BoundValue::BoundValue(llvm::Constant* value,
 	llvm::CmpInst::Predicate pred,
 	const BoundValue* prevState)
-	: boundType(value->getType())
 {
+	BoundFact fact;
+	fact.boundType = value->getType();
 	if (auto* constint = dyn_cast<ConstantInt>(value)) {
 		int64_t val = constint->getSExtValue();
 		std::pair<float, BOUND> p = predicateBound(val, pred, prevState);
-		range_entropy = p.first;
-		range = p.second;
-		widen(*this);
+		fact.range_entropy = p.first;
+		fact.range = p.second;
+		widen(fact);
 	}
+	assign(fact);
 }
 
 BoundValue::BoundValue(const BoundValue& other,
 	llvm::CmpInst::Predicate pred,
 	const BoundValue* prevState)
-	: boundType(other.boundType)
 {
-	if (other.range) {
-		std::pair<float, BOUND> p = predicateBound(other.range->first, pred, prevState);
-		std::pair<float, BOUND> p2 = predicateBound(other.range->second, pred, prevState);
+	BoundFact fact;
+	fact.boundType = other.type();
+	if (const BOUND& range = other.range()) {
+		std::pair<float, BOUND> p = predicateBound(range->first, pred, prevState);
+		std::pair<float, BOUND> p2 = predicateBound(range->second, pred, prevState);
 
-		range_entropy = (p.first + p2.first) / 2;
-		range = BOUND({
+		fact.range_entropy = (p.first + p2.first) / 2;
+		fact.range = BOUND({
 			std::min(p.second->first, p2.second->first),
 			std::max(p.second->second, p2.second->second)
 		});
-		widen(*this);
+		widen(fact);
 	}
+	assign(fact);
 }
 
-BoundValue::BoundValue(BOUND range, Type* boundType) : range(range), boundType(boundType) {
-	widen(*this);
+BoundValue::BoundValue(BOUND range, Type* boundType) {
+	BoundFact fact;
+	fact.range = range;
+	fact.boundType = boundType;
+	widen(fact);
+	assign(fact);
 }
 
 BoundValue::BoundValue(const BoundValue& v,
 	std::function<optional<int64_t>(int64_t,Type*)> eval)
 {
+	BoundFact src = v.fact();
+	BoundFact fact;
 	if (v.isInf()) {
-		range = v.range;
-		range_entropy = v.range_entropy;
+		fact.range = src.range;
+		fact.range_entropy = src.range_entropy;
+		assign(fact);
 		return;
 	}
-	boundType = v.boundType;
-	int64_t min1 = v.range->first;
-	int64_t max1 = v.range->second;
+	fact.boundType = src.boundType;
+	int64_t min1 = src.range->first;
+	int64_t max1 = src.range->second;
 	std::vector<int64_t> candidates = {min1, max1};
-	optional<int64_t> cand = eval(min1, boundType);
+	optional<int64_t> cand = eval(min1, fact.boundType);
 	if (cand) {
 		candidates.push_back(cand.value());
-		candidates.push_back(eval(max1, boundType).value());
-		range = BOUND({
+		candidates.push_back(eval(max1, fact.boundType).value());
+		fact.range = BOUND({
 			*(std::min_element(candidates.begin(), candidates.end())),
 			*(std::max_element(candidates.begin(), candidates.end()))
 		});
-		range_entropy = v.range_entropy;
+		fact.range_entropy = src.range_entropy;
 	}
-	widen(*this);
+	widen(fact);
+	assign(fact);
 }
 
 BoundValue::BoundValue(const BoundValue& v1, const BoundValue& v2,
 	std::function<optional<int64_t>(int64_t,int64_t,Type*)> eval)
 {
 	if (v1.isInf()) {
-		range = v1.range;
-		range_entropy = v1.range_entropy;
+		BoundFact fact;
+		fact.range = v1.range();
+		fact.range_entropy = v1.entropy();
+		assign(fact);
 		return;
 	}
 	if (v2.isInf()) {
-		range = v2.range;
-		range_entropy = v2.range_entropy;
+		BoundFact fact;
+		fact.range = v2.range();
+		fact.range_entropy = v2.entropy();
+		assign(fact);
 		return;
 	}
-	boundType = v1.boundType;
-	int64_t min1 = v1.range->first;
-	int64_t max1 = v1.range->second;
-	int64_t min2 = v2.range->first;
-	int64_t max2 = v2.range->second;
+	BoundFact src1 = v1.fact();
+	BoundFact src2 = v2.fact();
+	BoundFact fact;
+	fact.boundType = src1.boundType;
+	int64_t min1 = src1.range->first;
+	int64_t max1 = src1.range->second;
+	int64_t min2 = src2.range->first;
+	int64_t max2 = src2.range->second;
 	std::vector<int64_t> candidates;
-	optional<int64_t> cand = eval(min1, min2, boundType);
+	optional<int64_t> cand = eval(min1, min2, fact.boundType);
 	if (cand) {
 		candidates.push_back(cand.value());
-		candidates.push_back(eval(max1, max2, boundType).value());
-		candidates.push_back(eval(min1, max2, boundType).value());
-		candidates.push_back(eval(max1, min2, boundType).value());
+		candidates.push_back(eval(max1, max2, fact.boundType).value());
+		candidates.push_back(eval(min1, max2, fact.boundType).value());
+		candidates.push_back(eval(max1, min2, fact.boundType).value());
 		// todo: account for undefined behavior like divide by zero
 		if (min1 < 0 && max1 > 0) {
-			candidates.push_back(eval(0, min2, boundType).value());
-			candidates.push_back(eval(0, max2, boundType).value());
+			candidates.push_back(eval(0, min2, fact.boundType).value());
+			candidates.push_back(eval(0, max2, fact.boundType).value());
 		}
 		if (min2 < 0 && max2 > 0) {
-			candidates.push_back(eval(0, min1, boundType).value());
-			candidates.push_back(eval(0, max1, boundType).value());
+			candidates.push_back(eval(0, min1, fact.boundType).value());
+			candidates.push_back(eval(0, max1, fact.boundType).value());
 		}
-		range = BOUND({
+		fact.range = BOUND({
 			*(std::min_element(candidates.begin(), candidates.end())),
 			*(std::max_element(candidates.begin(), candidates.end()))
 		});
 		// mean entropy value on transfer function
-		range_entropy = (v1.range_entropy + v2.range_entropy) / 2;
+		fact.range_entropy = (src1.range_entropy + src2.range_entropy) / 2;
+	}
+	widen(fact);
+	assign(fact);
+}
+
+const BoundFact&
+BoundValue::interned() const {
+	return boundFacts().get(id);
+}
+
+void
+BoundValue::assign(const BoundFact& fact) {
+	id = boundFacts().intern(fact);
+	range_entropy = fact.range_entropy;
+}
+
+BoundFact
+BoundValue::fact() const {
+	BoundFact fact = interned();
+	fact.range_entropy = range_entropy;
+	return fact;
+}
+
+std::ostream&
+operator << (std::ostream& out, const BoundValue& v) {
+	if (const BOUND& range = v.range()) {
+		printBound(out, range);
+	}
+	else {
+		out << "undef";
 	}
-	widen(*this);
+	return out;
+}
+
+
+void
+BoundValue::makeTop() {
+	BoundFact top = fact();
+	top.range = BOUND({NEGINF, INF});
+	assign(top);
 }
 
 BoundValue
@@ -239,18 +486,25 @@ BoundValue::operator | (const BoundValue& other) const {
 	}
 
 	else if (hasRange() && other.hasRange()) {
-		BoundValue met(BOUND({
-			std::min(range->first, other.range->first),
-			std::max(range->second, other.range->second)
-		}), boundType);
-		// determine range_entropy by overlap
-		unsigned overlap = getOverlap(range, other.range);
-		float tpercent = overlap / (range->second - range->first + 1);
-		float opercent = overlap / (other.range->second - other.range->first + 1);
-		met.range_entropy = (1.0-tpercent) * range_entropy + (1.0-opercent) * other.range_entropy +
-							(tpercent*range_entropy + opercent*other.range_entropy) / 2.0;
-		widen(met);
-		return met;
+		return boundFacts().meet(*this, other, [this, &other] {
+			const BOUND& range = this->range();
+			const BOUND& otherRange = other.range();
+			BoundFact met;
+			met.range = BOUND({
+				std::min(range->first, otherRange->first),
+				std::max(range->second, otherRange->second)
+			});
+			met.boundType = type();
+			widen(met);
+			// determine range_entropy by overlap
+			unsigned overlap = getOverlap(range, otherRange);
+			float tpercent = overlap / (range->second - range->first + 1);
+			float opercent = overlap / (otherRange->second - otherRange->first + 1);
+			met.range_entropy = (1.0-tpercent) * entropy() + (1.0-opercent) * other.entropy() +
+								(tpercent*entropy() + opercent*other.entropy()) / 2.0;
+			widen(met);
+			return BoundValue(met);
+		});
 	}
 	else if (hasRange()) {
 		return *this;
@@ -266,28 +520,37 @@ BoundValue::operator == (const BoundValue& other) const {
 
 bool
 BoundValue::hasRange() const {
-	return bool(range);
+	return bool(range());
 }
 
 
 BoundValue
-BoundMeet::meetPair(BoundValue& s1, BoundValue& s2) const {
+BoundMeet::meetPair(const BoundValue& s1, const BoundValue& s2) const {
 	return s1 | s2;
 }
 
 
+template <typename State>
 BoundValue
-BoundTransfer::getBoundValueFor(llvm::Value* v, BoundState& state) const {
+BoundTransfer::getBoundValueFor(llvm::Value* v, State& state) const {
 	if (auto* constant = llvm::dyn_cast<llvm::Constant>(v)) {
-		return BoundValue{constant};
+		// plain constants are the most rebuilt values of all
+		auto found = session->constants.find(constant);
+		if (session->constants.end() != found) {
+			return found->second;
+		}
+		BoundValue value{constant};
+		session->constants[constant] = value;
+		return value;
 	}
 	return state[v];
 }
 
 
+template <typename State>
 BoundValue
 BoundTransfer::evaluateBinaryOperator(llvm::BinaryOperator& binOp,
-					   BoundState& state) const {
+					   State& state) const {
 	auto* op1   = binOp.getOperand(0);
 	auto* op2   = binOp.getOperand(1);
 	auto value1 = getBoundValueFor(op1, state);
@@ -295,13 +558,25 @@ BoundTransfer::evaluateBinaryOperator(llvm::BinaryOperator& binOp,
 
 	if (value1.hasRange() && value2.hasRange()) {
 		auto& layout = binOp.getModule()->getDataLayout();
-		return BoundValue{value1, value2,
-		[&binOp, &layout](int64_t v1, int64_t v2, Type* type) -> optional<int64_t> {
+		TransferKey key{binOp.getOpcode(), binOp.getType(),
+			value1.getId(), value2.getId()};
+		auto found = session->transfers.find(key);
+		if (session->transfers.end() != found) {
+			return found->second;
+		}
+		auto* constantFolds = session->countFolds ? &session->constantFolds : nullptr;
+		BoundValue value{value1, value2,
+		[&binOp, &layout, constantFolds](int64_t v1, int64_t v2, Type* type) -> optional<int64_t> {
+			if (constantFolds) {
+				(*constantFolds)[binOp.getFunction()] += 3;
+			}
 			Constant* c1 = toConstant(v1, type);
 			Constant* c2 = toConstant(v2, type);
 			Constant* ans = ConstantFoldBinaryOpOperands(binOp.getOpcode(), c1, c2, layout);
 			return toInt(ans);
 		}};
+		session->transfers.insert({key, value});
+		return value;
 	} else {
 		// we're evaluating undefined variables... wat?
 		return BoundValue();
@@ -309,20 +584,32 @@ BoundTransfer::evaluateBinaryOperator(llvm::BinaryOperator& binOp,
 }
 
 
+template <typename State>
 BoundValue
-BoundTransfer::evaluateCast(llvm::CastInst& castOp, BoundState& state) const {
+BoundTransfer::evaluateCast(llvm::CastInst& castOp, State& state) const {
 	auto* op   = castOp.getOperand(0);
 	auto value = getBoundValueFor(op, state);
 
 	if (value.hasRange()) {
 		auto& layout = castOp.getModule()->getDataLayout();
-		return BoundValue{value,
-		[&castOp, &layout](int64_t v, Type* type) -> optional<int64_t> {
+		TransferKey key{castOp.getOpcode(), castOp.getDestTy(), value.getId(), 0};
+		auto found = session->transfers.find(key);
+		if (session->transfers.end() != found) {
+			return found->second;
+		}
+		auto* constantFolds = session->countFolds ? &session->constantFolds : nullptr;
+		BoundValue cast{value,
+		[&castOp, &layout, constantFolds](int64_t v, Type* type) -> optional<int64_t> {
+			if (constantFolds) {
+				(*constantFolds)[castOp.getFunction()] += 2;
+			}
 			Constant* c = toConstant(v, type);
 			Constant* ans = ConstantFoldCastOperand(castOp.getOpcode(), c,
 							castOp.getDestTy(), layout);
 			return toInt(ans);
 		}};
+		session->transfers.insert({key, cast});
+		return cast;
 	} else {
 		// we're casting an undefined variable
 		return BoundValue();
@@ -330,22 +617,9 @@ BoundTransfer::evaluateCast(llvm::CastInst& castOp, BoundState& state) const {
 }
 
 
-struct ErrReport {
-	llvm::Function* f;
-	std::vector<unsigned> context;
-	size_t lineno;
-	size_t buffersize;
-	BOUND access;
-};
-
-
-static llvm::DenseSet<ErrReport*> errorLog;
-// encode context for call depth of 2 todo: generalize
-static std::unordered_map<unsigned, llvm::DenseMap<llvm::Value*, ErrReport*> > potentialError;
-
-
+template <typename State>
 static BOUND
-checkError(Value* idx, signed limit, BoundState& state) {
+checkError(Value* idx, signed limit, State& state) {
 	BOUND b;
 	if (nullptr == idx) {
 		return b;
@@ -358,7 +632,7 @@ checkError(Value* idx, signed limit, BoundState& state) {
 		return iidx < limit && iidx >= 0 ? b : BOUND({iidx, iidx});
 	}
 	else if (state.end() != inst){
-		b = inst->second.range;
+		b = inst->second.range();
 		if (b) {
 			return b->second < limit && b->first >= 0 ? BOUND() : b;
 		}
@@ -372,8 +646,47 @@ checkError(Value* idx, signed limit, BoundState& state) {
 }
 
 
-static unsigned
-contextEncode(std::vector<unsigned>& context) {
+// checkError only looks at the gep's second index, so it covers everything
+// the gep can address only when the first index stays on the base object
+static bool
+isCheckedShape(GetElementPtrInst& gep) {
+	if (3 != gep.getNumOperands()) {
+		return false;
+	}
+	auto* base = dyn_cast<ConstantInt>(gep.getOperand(1));
+	Type* source = gep.getSourceElementType();
+	return base && base->isZero() &&
+		(source->isArrayTy() || source->isVectorTy() || source->isStructTy());
+}
+
+
+// Unlike checkError, which also passes indices it knows nothing about, this
+// requires the index to be known within the indexed type.
+template <typename State>
+static bool
+provenInBounds(GetElementPtrInst& gep, signed limit, State& state) {
+	if (!isCheckedShape(gep)) {
+		return false;
+	}
+	Value* idx = gep.getOperand(2);
+	BOUND b;
+	if (auto* c = dyn_cast<Constant>(idx)) {
+		if (optional<int64_t> i = toInt(c)) {
+			b = BOUND({i.value(), i.value()});
+		}
+	}
+	else {
+		auto found = state.find(idx);
+		if (state.end() != found) {
+			b = found->second.range();
+		}
+	}
+	return b && b->first >= 0 && b->second < limit;
+}
+
+
+unsigned
+contextEncode(const std::vector<unsigned>& context) {
 	unsigned total = 0;
 	for (size_t i = 0; i < context.size(); i++) {
 		total += (i+1) * context[i] % massivePrime;
@@ -382,8 +695,9 @@ contextEncode(std::vector<unsigned>& context) {
 }
 
 
+template <typename State>
 void
-BoundTransfer::operator()(llvm::Instruction& i, BoundState& state, std::vector<unsigned>& context) {
+BoundTransfer::operator()(llvm::Instruction& i, State& state, std::vector<unsigned>& context) {
 	// error check instruction
 	// if error, then state is instantly undefined
 	if (GetElementPtrInst* gep = llvm::dyn_cast<GetElementPtrInst>(&i)) {
@@ -391,6 +705,10 @@ BoundTransfer::operator()(llvm::Instruction& i, BoundState& state, std::vector<u
 		Value* idx = gep->getOperand(2);
 		std::vector<unsigned> byteWidth = getByteWidth(gep->getSourceElementType(), limit);
 
+		// proven safe only if every visit in every context proves it
+		auto& safe = session->provenSafe.insert({gep, true}).first->second;
+		safe = safe && provenInBounds(*gep, byteWidth.size(), state);
+
 		if (BOUND b = checkError(idx, byteWidth.size(), state)) {
 			state[&i] = BoundValue();
 			optional<unsigned> lineno = getLineNumber(i);
@@ -398,20 +716,26 @@ BoundTransfer::operator()(llvm::Instruction& i, BoundState& state, std::vector<u
 			b->second *= byteWidth.back();
 			if (lineno) {
 				// cache this as potential error, wrt to i, then log if and only if there is a store/read on instruction i
-				potentialError[contextEncode(context)].insert({gep, new ErrReport{ i.getFunction(), context, lineno.value(), limit, b }});
+				// only the first report is kept, so avoid allocating on revisits
+				auto& potentials = session->potentialError[contextEncode(context)];
+				if (potentials.end() == potentials.find(gep)) {
+					potentials.insert({gep, new ErrReport{ i.getFunction(), context, lineno.value(), limit, b }});
+				}
 			}
 		}
 	}
 	else if (LoadInst* getter = llvm::dyn_cast<llvm::LoadInst>(&i)) {
-		auto gpair = potentialError[contextEncode(context)].find(getter->getPointerOperand());
-		if (potentialError[contextEncode(context)].end() != gpair) {
-			errorLog.insert(gpair->second);
+		auto& potentials = session->potentialError[contextEncode(context)];
+		auto gpair = potentials.find(getter->getPointerOperand());
+		if (potentials.end() != gpair) {
+			session->errorLog.insert(gpair->second);
 		}
 	}
 	else if (StoreInst* setter = llvm::dyn_cast<llvm::StoreInst>(&i)) {
-		auto spair = potentialError[contextEncode(context)].find(setter->getPointerOperand());
-		if (potentialError[contextEncode(context)].end() != spair) {
-			errorLog.insert(spair->second);
+		auto& potentials = session->potentialError[contextEncode(context)];
+		auto spair = potentials.find(setter->getPointerOperand());
+		if (potentials.end() != spair) {
+			session->errorLog.insert(spair->second);
 		}
 	}
 	// actual transfer functions
@@ -436,40 +760,830 @@ BoundTransfer::operator()(llvm::Instruction& i, BoundState& state, std::vector<u
 }
 
 
+template void
+BoundTransfer::operator()(llvm::Instruction& i, BoundState& state,
+	std::vector<unsigned>& context);
+
+template void
+BoundTransfer::operator()(llvm::Instruction& i, BoundComponentState& state,
+	std::vector<unsigned>& context);
+
+
+// header values of an affine recurrence are start + step * k for every k up
+// to the number of backedges taken
+static void
+accelerateLoop(Loop* loop, ScalarEvolution& se,
+	BoundAcceleration::HeaderValues& values) {
+	for (Loop* inner : *loop) {
+		accelerateLoop(inner, se, values);
+	}
+
+	const SCEV* taken = se.getBackedgeTakenCount(loop);
+	if (isa<SCEVCouldNotCompute>(taken)) {
+		taken = se.getMaxBackedgeTakenCount(loop);
+	}
+	auto* takenConst = dyn_cast<SCEVConstant>(taken);
+	if (nullptr == takenConst ||
+		takenConst->getAPInt().getActiveBits() > 62) {
+		return; // not counted, leave it to widening
+	}
+	int64_t backedges = takenConst->getAPInt().getZExtValue();
+
+	for (auto& inst : *loop->getHeader()) {
+		auto* phi = dyn_cast<PHINode>(&inst);
+		if (nullptr == phi) {
+			break;
+		}
+		auto* intTy = dyn_cast<IntegerType>(phi->getType());
+		if (nullptr == intTy) {
+			continue;
+		}
+		auto* rec = dyn_cast<SCEVAddRecExpr>(se.getSCEV(phi));
+		if (nullptr == rec || !rec->isAffine() || rec->getLoop() != loop) {
+			continue;
+		}
+		auto* start = dyn_cast<SCEVConstant>(rec->getStart());
+		auto* step = dyn_cast<SCEVConstant>(rec->getStepRecurrence(se));
+		if (nullptr == start || nullptr == step) {
+			continue;
+		}
+
+		int64_t first = start->getAPInt().getSExtValue();
+		int64_t last;
+		if (__builtin_mul_overflow(step->getAPInt().getSExtValue(), backedges, &last) ||
+			__builtin_add_overflow(first, last, &last)) {
+			continue;
+		}
+		// the domain reads constants sign extended, so the recurrence must
+		// not wrap within the phi's type
+		unsigned bits = intTy->getBitWidth();
+		if (bits < 64 && (!isIntN(bits, first) || !isIntN(bits, last))) {
+			continue;
+		}
+		if (first >= INF || first <= NEGINF || last >= INF || last <= NEGINF) {
+			continue;
+		}
+
+		// widen() only grows values whose entropy is below one half, so mark
+		// the closed form range as settled
+		BoundFact bound;
+		bound.range = BOUND({std::min(first, last), std::max(first, last)});
+		bound.range_entropy = 1.0;
+		bound.boundType = intTy;
+		values[phi] = BoundValue(bound);
+	}
+}
+
+
+BoundAcceleration::HeaderValues
+accelerateLoops(llvm::Function& f) {
+	BoundAcceleration::HeaderValues values;
+	DominatorTree dt(f);
+	LoopInfo loops(dt);
+	if (loops.empty()) {
+		return values;
+	}
+
+	TargetLibraryInfoImpl tlii(Triple(f.getParent()->getTargetTriple()));
+	TargetLibraryInfo tli(tlii);
+	AssumptionCache ac(f);
+	ScalarEvolution se(f, tli, ac, dt, loops);
+	for (Loop* loop : loops) {
+		accelerateLoop(loop, se, values);
+	}
+	return values;
+}
+
+
+bool
+checksOperand(llvm::Instruction& i, unsigned operand) {
+	return isa<GetElementPtrInst>(i) && 2 == operand;
+}
+
+
+// A gep with a constant index is decided without the dataflow: checkError
+// only ever reports it when the index lies outside the indexed type.
+static bool
+needsDataflow(GetElementPtrInst& gep) {
+	if (gep.getNumOperands() < 3) {
+		return false;
+	}
+	auto* c = dyn_cast<Constant>(gep.getOperand(2));
+	if (nullptr == c) {
+		return true;
+	}
+	unsigned limit = 0;
+	signed size = getByteWidth(gep.getSourceElementType(), limit).size();
+	optional<int64_t> idx = toInt(c);
+	return !idx || idx.value() < 0 || idx.value() >= size;
+}
+
+
+llvm::DenseSet<llvm::Function*>
+relevantFunctions(llvm::Module& m, bool callsOut) {
+	llvm::DenseSet<llvm::Function*> relevant;
+	llvm::DenseMap<llvm::Function*, std::vector<llvm::Function*> > callers;
+	std::vector<llvm::Function*> work;
+	for (auto& f : m) {
+		bool checks = false;
+		for (auto& i : llvm::instructions(f)) {
+			if (auto* gep = dyn_cast<GetElementPtrInst>(&i)) {
+				checks = checks || needsDataflow(*gep);
+			}
+			else if (auto* call = dyn_cast<CallInst>(&i)) {
+				llvm::Function* callee = call->getCalledFunction();
+				if (callee && !callee->isDeclaration()) {
+					callers[callee].push_back(&f);
+				}
+				else if (callee && callsOut && !callee->isIntrinsic()) {
+					checks = true;
+				}
+			}
+		}
+		if (checks && relevant.insert(&f).second) {
+			work.push_back(&f);
+		}
+	}
+
+	// Callers of a relevant function analyze it again in their own context,
+	// so they are relevant too. Functions that only feed a relevant one
+	// through return values are still analyzed on demand from its callers.
+	while (!work.empty()) {
+		llvm::Function* f = work.back();
+		work.pop_back();
+		for (llvm::Function* caller : callers.lookup(f)) {
+			if (relevant.insert(caller).second) {
+				work.push_back(caller);
+			}
+		}
+	}
+	return relevant;
+}
+
+
+OverflowerSession::OverflowerSession(const BoundOptions& options)
+	: options(options),
+	summaryStore(summaries, size_t(options.summaryCacheMb) << 20),
+	loops(accelerateLoops),
+	liveness(checksOperand) {}
+
+
+// Spills are read back by the session that wrote them, so a spilled value
+// only has to intern its fact again, and types may be written as pointers.
+static void
+encodeBound(const BoundValue& value, std::string& out) {
+	BoundFact fact = value.fact();
+	char defined = fact.range ? 1 : 0;
+	int64_t bounds[2] = {0, 0};
+	if (fact.range) {
+		bounds[0] = fact.range->first;
+		bounds[1] = fact.range->second;
+	}
+	uintptr_t type = reinterpret_cast<uintptr_t>(fact.boundType);
+	out.append(&defined, sizeof(defined));
+	out.append(reinterpret_cast<const char*>(bounds), sizeof(bounds));
+	out.append(reinterpret_cast<const char*>(&fact.range_entropy),
+		sizeof(fact.range_entropy));
+	out.append(reinterpret_cast<const char*>(&type), sizeof(type));
+}
+
+
+static BoundValue
+decodeBound(const char*& in) {
+	BoundFact fact;
+	char defined = 0;
+	int64_t bounds[2];
+	uintptr_t type = 0;
+	memcpy(&defined, in, sizeof(defined));
+	in += sizeof(defined);
+	memcpy(bounds, in, sizeof(bounds));
+	in += sizeof(bounds);
+	memcpy(&fact.range_entropy, in, sizeof(fact.range_entropy));
+	in += sizeof(fact.range_entropy);
+	memcpy(&type, in, sizeof(type));
+	in += sizeof(type);
+	if (defined) {
+		fact.range = BOUND({bounds[0], bounds[1]});
+	}
+	fact.boundType = reinterpret_cast<Type*>(type);
+	return BoundValue(fact);
+}
+
+
+bool
+OverflowerSession::spillSummaries(const std::string& path) {
+	return summaryStore.enableSpill(path, encodeBound, decodeBound);
+}
+
+
+OverflowerSession::~OverflowerSession() {
+	clear();
+}
+
+
+BoundResult
+OverflowerSession::analyzeFunction(llvm::Function& f) {
+	BoundFacts::Scope scope(&facts);
+	return analyzeFunction(f, false);
+}
+
+
+BoundResult
+OverflowerSession::analyzeFunction(llvm::Function& f, bool topArguments) {
+	std::vector<BoundValue> Args = {BoundValue()};
+	// the arguments calls take then, so each function is analyzed just once
+	if (topArguments && !f.arg_empty()) {
+		Args.assign(f.arg_size(), BoundValue());
+		for (auto& arg : Args) {
+			arg.makeTop();
+		}
+	}
+	return analyzeFunction(f, Args, {}, topArguments);
+}
+
+
+BoundResult
+OverflowerSession::analyzeInContext(llvm::Function& f,
+	const std::vector<BoundValue>& args, const std::vector<unsigned>& context) {
+	BoundFacts::Scope scope(&facts);
+	std::vector<BoundValue> Args = args;
+	return analyzeFunction(f, Args, context, false);
+}
+
+
+BoundResult
+OverflowerSession::analyzeFunction(llvm::Function& f,
+	std::vector<BoundValue>& args, const std::vector<unsigned>& context,
+	bool topArguments) {
+	analysis::ForwardDataflowAnalysis<BoundValue,
+			BoundTransfer,
+			BoundMeet> analysis(context, &stats, BoundTransfer(*this));
+	analysis.enableRegionParallelism(options.parallelBlocks, options.threads);
+	analysis.setMaxContextDepth(options.contextDepth);
+	analysis.enableTopArguments(topArguments);
+	analysis.enableLaneBatching(options.batchLanes);
+	analysis.enableTrace(trace);
+	if (sharedSummaries) {
+		analysis.enableSummaryStore(sharedSummaries);
+	}
+	else if (options.summaryCacheMb) {
+		analysis.enableSummaryStore(&summaryStore);
+	}
+	if (options.cacheTransfers) {
+		analysis.enableTransferCache(&effects);
+	}
+	if (options.accelerateLoops) {
+		analysis.enableLoopAcceleration(&loops);
+	}
+	if (options.pruneStates) {
+		analysis.enableStatePruning(&liveness);
+	}
+	if (externals) {
+		analysis.enableExternalCalls(externals);
+	}
+	return analysis.computeForwardDataflow(summaries, f, args);
+}
+
+
 void
-printErrors(std::ostream& out) {
-	for (ErrReport* report : errorLog) {
-		if (!report->context.empty()) {
-			out << report->context.front();
-			for (auto it = ++report->context.begin(); it != report->context.end(); it++) {
-				out << ":" << *it;
+OverflowerSession::analyzeFunctions(llvm::Module& m,
+	const llvm::DenseSet<llvm::Function*>* only, bool sharded,
+	bool topArguments, MemoryProfile* profile, RangeIndexWriter* index) {
+	unsigned position = 0;
+	for (auto& f : m) {
+		if (f.isDeclaration()) {
+			continue;
+		}
+		if (only && 0 == only->count(&f)) {
+			continue;
+		}
+		if (sharded && options.shard != position++ % options.shards) {
+			continue;
+		}
+		if (checkpoint && checkpoint->isFinished(&f)) {
+			continue;
+		}
+		auto results = analyzeFunction(f, topArguments);
+		if (profile) {
+			profile->recordResults(f, results);
+		}
+		if (index) {
+			index->add(f, results);
+		}
+		if (checkpoint) {
+			checkpoint->functionDone(*this, f);
+		}
+	}
+}
+
+
+llvm::DenseSet<llvm::Function*>
+OverflowerSession::escalatedFunctions(llvm::Module& m) const {
+	llvm::DenseMap<llvm::Function*, std::vector<llvm::Function*> > callers;
+	for (auto& f : m) {
+		for (auto& i : llvm::instructions(f)) {
+			if (auto* call = dyn_cast<CallInst>(&i)) {
+				llvm::Function* callee = call->getCalledFunction();
+				if (callee && !callee->isDeclaration()) {
+					callers[callee].push_back(&f);
+				}
+			}
+		}
+	}
+
+	// Without contexts callees only see Top arguments, so each potential
+	// error marks an access whose function may be more precise with its
+	// callees followed in context, or in the contexts of its callers.
+	llvm::DenseSet<llvm::Function*> escalated;
+	std::vector<llvm::Function*> level;
+	for (auto& contextErrors : potentialError) {
+		for (auto& potential : contextErrors.second) {
+			if (escalated.insert(potential.second->f).second) {
+				level.push_back(potential.second->f);
 			}
 		}
-		out << ", " << report->f->getName().data() << ", " << report->lineno << ", " << report->buffersize << ", ";
-		int64_t bot = report->access->first;
-		int64_t top = report->access->second;
-		if (bot <= NEGINF) {
-			out << "-inf:";
+	}
+
+	// A caller k calls up analyzes the function in a context of k-1 call
+	// sites, which is only followed within the context depth.
+	for (int distance = 1; distance <= options.contextDepth + 1; distance++) {
+		std::vector<llvm::Function*> next;
+		for (llvm::Function* f : level) {
+			for (llvm::Function* caller : callers.lookup(f)) {
+				if (escalated.insert(caller).second) {
+					next.push_back(caller);
+				}
+			}
+		}
+		level = std::move(next);
+	}
+	return escalated;
+}
+
+
+void
+OverflowerSession::analyzeModule(llvm::Module& m, MemoryProfile* profile,
+	RangeIndexWriter* index) {
+	BoundFacts::Scope scope(&facts);
+	llvm::DenseSet<llvm::Function*> relevant;
+	if (options.pruneIrrelevant) {
+		relevant = relevantFunctions(m, nullptr != externals);
+	}
+	const llvm::DenseSet<llvm::Function*>* only =
+		options.pruneIrrelevant ? &relevant : nullptr;
+	countFolds = nullptr != profile;
+
+	if (!options.adaptiveContexts) {
+		analyzeFunctions(m, only, true, false, profile, index);
+	}
+	else {
+		// one context insensitive pass over everything, then the call chains
+		// leading to its potential errors again with full contexts, unless a
+		// resumed checkpoint got that far already
+		llvm::DenseSet<llvm::Function*> escalated;
+		if (checkpoint && checkpoint->getEscalated()) {
+			escalated = *checkpoint->getEscalated();
 		}
 		else {
-			out << bot << ":";
+			analyzeFunctions(m, only, true, true, profile, index);
+			escalated = escalatedFunctions(m);
+			escalateTo(escalated);
+			if (checkpoint) {
+				checkpoint->escalate(*this, escalated);
+			}
 		}
-		if (top >= INF) {
-			out << "inf\n";
-		} else {
-			out << top << "\n";
+		// a shard escalates from its own potential errors, which only it
+		// found, so it analyzes every function they lead to
+		analyzeFunctions(m, &escalated, false, false, profile, index);
+	}
+
+	if (checkpoint) {
+		checkpoint->write(*this);
+	}
+	if (profile) {
+		profile->recordSummaries(summaries);
+		profile->recordReports(*this);
+	}
+}
+
+
+void
+OverflowerSession::escalateTo(const llvm::DenseSet<llvm::Function*>& escalated) {
+	// summaries are for Top arguments and the reports all came from
+	// escalated functions, so both are recomputed
+	clearReports();
+	summaries.clear();
+	summaryStore.clear();
+	if (sharedSummaries) {
+		sharedSummaries->invalidate();
+	}
+	for (llvm::Function* f : escalated) {
+		for (auto& i : llvm::instructions(*f)) {
+			provenSafe.erase(&i);
 		}
 	}
 }
 
 
+std::vector<ErrReport>
+OverflowerSession::getReports() const {
+	std::vector<ErrReport> reports;
+	for (ErrReport* report : errorLog) {
+		reports.push_back(*report);
+	}
+	return reports;
+}
+
+
 void
-clearReports() {
+OverflowerSession::printReports(std::ostream& out) const {
 	for (ErrReport* report : errorLog) {
-		delete report;
+		printReport(out, *report);
+	}
+}
+
+
+void
+OverflowerSession::merge(const OverflowerSession& other) {
+	for (auto& contextErrors : other.potentialError) {
+		auto& potentials = potentialError[contextErrors.first];
+		for (auto& potential : contextErrors.second) {
+			auto found = potentials.find(potential.first);
+			ErrReport* report = nullptr;
+			if (potentials.end() != found) {
+				report = found->second;
+			}
+			else {
+				report = new ErrReport(*potential.second);
+				potentials.insert({potential.first, report});
+			}
+			if (other.errorLog.count(potential.second)) {
+				errorLog.insert(report);
+			}
+		}
+	}
+	for (auto& safe : other.provenSafe) {
+		auto& merged = provenSafe.insert({safe.first, true}).first->second;
+		merged = merged && safe.second;
 	}
+	stats.analyses += other.stats.analyses;
+	stats.blockVisits += other.stats.blockVisits;
+	stats.transfers += other.stats.transfers;
+	stats.takesSaved += other.stats.takesSaved;
+}
+
+
+void
+printReport(std::ostream& out, const ErrReport& report) {
+	if (!report.context.empty()) {
+		out << report.context.front();
+		for (auto it = ++report.context.begin(); it != report.context.end(); it++) {
+			out << ":" << *it;
+		}
+	}
+	out << ", " << report.f->getName().data() << ", " << report.lineno << ", " << report.buffersize << ", ";
+	printBound(out, report.access);
+	out << "\n";
+}
+
+
+llvm::DenseSet<llvm::Instruction*>
+OverflowerSession::getSafeAccesses(llvm::Module& m) const {
+	llvm::DenseSet<llvm::Instruction*> safe;
+	for (auto& f : m) {
+		for (auto& i : llvm::instructions(f)) {
+			auto* gep = dyn_cast<GetElementPtrInst>(&i);
+			if (nullptr == gep) {
+				continue;
+			}
+			auto visited = provenSafe.find(gep);
+			bool proven = provenSafe.end() != visited
+				? visited->second
+				// geps that were never analyzed can only be decided statically
+				: !needsDataflow(*gep) && isCheckedShape(*gep);
+			if (proven) {
+				safe.insert(gep);
+			}
+		}
+		for (auto& i : llvm::instructions(f)) {
+			Value* ptr = nullptr;
+			if (auto* getter = dyn_cast<LoadInst>(&i)) {
+				ptr = getter->getPointerOperand();
+			}
+			else if (auto* setter = dyn_cast<StoreInst>(&i)) {
+				ptr = setter->getPointerOperand();
+			}
+			auto* gep = dyn_cast_or_null<Instruction>(ptr);
+			if (gep && safe.count(gep)) {
+				safe.insert(&i);
+			}
+		}
+	}
+	return safe;
+}
+
+
+void
+OverflowerSession::printSafeAccesses(llvm::Module& m, std::ostream& out) const {
+	auto safe = getSafeAccesses(m);
+	out << "# function, instructions, safe instruction indices\n";
+	for (auto& f : m) {
+		std::vector<unsigned> indices;
+		unsigned index = 0;
+		for (auto& i : llvm::instructions(f)) {
+			if (safe.count(&i)) {
+				indices.push_back(index);
+			}
+			index++;
+		}
+		if (indices.empty()) {
+			continue;
+		}
+		out << f.getName().data() << ", " << index;
+		for (unsigned safeIndex : indices) {
+			out << ", " << safeIndex;
+		}
+		out << "\n";
+	}
+}
+
+
+llvm::DenseSet<llvm::Instruction*>
+readSafeAccesses(llvm::Module& m, std::istream& in) {
+	llvm::DenseSet<llvm::Instruction*> safe;
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line.empty() || '#' == line[0]) {
+			continue;
+		}
+		std::istringstream fields(line);
+		std::string name;
+		unsigned count = 0;
+		std::getline(fields, name, ',');
+		fields >> count;
+		llvm::Function* f = m.getFunction(name);
+		if (nullptr == f || f->isDeclaration()) {
+			continue;
+		}
+		std::vector<llvm::Instruction*> insts;
+		for (auto& i : llvm::instructions(*f)) {
+			insts.push_back(&i);
+		}
+		// indices are only meaningful for the exact IR that was analyzed
+		if (insts.size() != count) {
+			errs() << "overflower: " << name << " differs from the analyzed "
+				"function, no accesses are assumed safe\n";
+			continue;
+		}
+		char comma;
+		unsigned index;
+		while (fields >> comma >> index) {
+			if (index < count) {
+				safe.insert(insts[index]);
+			}
+		}
+	}
+	return safe;
+}
+
+
+void
+OverflowerSession::clearReports() {
+	// every logged report is also a potential one
+	for (auto& contextErrors : potentialError) {
+		for (auto& potential : contextErrors.second) {
+			delete potential.second;
+		}
+	}
+	potentialError.clear();
 	errorLog.clear();
 }
 
 
+void
+OverflowerSession::clear() {
+	BoundFacts::Scope scope(&facts);
+	clearReports();
+	constantFolds.clear();
+	transfers.clear();
+	constants.clear();
+	summaries.clear();
+	summaryStore.clear();
+	effects.clear();
+	provenSafe.clear();
+	loops = BoundAcceleration(accelerateLoops);
+	liveness.clear();
+	// nothing refers to a bound any more
+	facts.clear();
+}
+
+
+void
+RangeIndexWriter::add(llvm::Function& f, const BoundResult& results) {
+	llvm::DenseMap<llvm::Value*, uint32_t> numbers;
+	for (auto& arg : f.args()) {
+		numbers.insert({&arg, numbers.size()});
+	}
+	for (auto& i : llvm::instructions(f)) {
+		numbers.insert({&i, numbers.size()});
+	}
+
+	std::vector<Fact> facts;
+	uint32_t index = 0;
+	for (auto& i : llvm::instructions(f)) {
+		auto state = results.find(&i);
+		if (results.end() != state) {
+			auto record = [&] (llvm::Value* v) {
+				auto number = numbers.find(v);
+				auto value = state->second.find(v);
+				if (numbers.end() == number || state->second.end() == value) {
+					return;
+				}
+				if (const BOUND& range = value->second.range()) {
+					facts.push_back({index, number->second,
+						range->first <= NEGINF ? INT64_MIN : range->first,
+						range->second >= INF ? INT64_MAX : range->second});
+				}
+			};
+			record(&i);
+			for (auto& op : i.operands()) {
+				record(op.get());
+			}
+		}
+		index++;
+	}
+
+	std::sort(facts.begin(), facts.end(), [](const Fact& f1, const Fact& f2) {
+		return std::make_pair(f1.instruction, f1.value) <
+			std::make_pair(f2.instruction, f2.value);
+	});
+	facts.erase(std::unique(facts.begin(), facts.end(),
+		[](const Fact& f1, const Fact& f2) {
+			return f1.instruction == f2.instruction && f1.value == f2.value;
+		}), facts.end());
+
+	StringRef name = f.getName();
+	uint64_t hash = rangeindex::hashName(name.data(), name.size());
+	// a function analyzed again, e.g. with deeper contexts, replaces its facts
+	auto position = positions.find(hash);
+	if (positions.end() != position) {
+		functions[position->second].second = std::move(facts);
+		return;
+	}
+	positions.insert({hash, functions.size()});
+	functions.push_back({hash, std::move(facts)});
+}
+
+
+void
+RangeIndexWriter::write(std::ostream& out) const {
+	std::vector<const std::pair<uint64_t, std::vector<Fact> >*> sorted;
+	uint64_t factCount = 0;
+	for (auto& function : functions) {
+		sorted.push_back(&function);
+		factCount += function.second.size();
+	}
+	std::sort(sorted.begin(), sorted.end(), [](auto* f1, auto* f2) {
+		return f1->first < f2->first;
+	});
+
+	auto aligned = [](uint64_t offset) { return (offset + 7) / 8 * 8; };
+	rangeindex::Header header;
+	memcpy(header.magic, rangeindex::magic, sizeof(header.magic));
+	header.version = rangeindex::version;
+	header.functionCount = sorted.size();
+	header.factCount = factCount;
+	header.functions = aligned(sizeof(header));
+	header.instructions = aligned(header.functions
+		+ sorted.size() * sizeof(rangeindex::Function));
+	header.values = aligned(header.instructions + factCount * sizeof(uint32_t));
+	header.lowers = aligned(header.values + factCount * sizeof(uint32_t));
+	header.uppers = header.lowers + factCount * sizeof(int64_t);
+
+	uint64_t written = 0;
+	auto put = [&out, &written](const void* data, uint64_t bytes) {
+		out.write(static_cast<const char*>(data), bytes);
+		written += bytes;
+	};
+	auto pad = [&put, &written, &aligned]() {
+		const char zeros[8] = {0};
+		put(zeros, aligned(written) - written);
+	};
+
+	put(&header, sizeof(header));
+	pad();
+	uint64_t firstFact = 0;
+	for (auto* function : sorted) {
+		rangeindex::Function entry{function->first, firstFact,
+			function->second.size()};
+		put(&entry, sizeof(entry));
+		firstFact += function->second.size();
+	}
+	pad();
+	for (auto* function : sorted) {
+		for (auto& fact : function->second) {
+			put(&fact.instruction, sizeof(uint32_t));
+		}
+	}
+	pad();
+	for (auto* function : sorted) {
+		for (auto& fact : function->second) {
+			put(&fact.value, sizeof(uint32_t));
+		}
+	}
+	pad();
+	for (auto* function : sorted) {
+		for (auto& fact : function->second) {
+			put(&fact.lower, sizeof(int64_t));
+		}
+	}
+	for (auto* function : sorted) {
+		for (auto& fact : function->second) {
+			put(&fact.upper, sizeof(int64_t));
+		}
+	}
+}
+
+
+FunctionFootprint&
+MemoryProfile::footprintOf(llvm::Function* f) {
+	FunctionFootprint& footprint = functions[f];
+	footprint.f = f;
+	return footprint;
+}
+
+
+void
+MemoryProfile::recordResults(llvm::Function& f, const BoundResult& results) {
+	// results are dropped once f is done, so keep the largest seen
+	FunctionFootprint& footprint = footprintOf(&f);
+	footprint.results = std::max(footprint.results,
+		analysis::approximateResultBytes<BoundValue>(results));
+}
+
+
+void
+MemoryProfile::recordSummaries(const BoundSummary& summaries) {
+	for (auto& funcSummary : summaries) {
+		footprintOf(funcSummary.first).summaries =
+			analysis::approximateSummaryBytes(funcSummary.second);
+	}
+}
+
+
+void
+MemoryProfile::recordReports(const OverflowerSession& session) {
+	for (auto& contextErrors : session.potentialError) {
+		for (auto& potential : contextErrors.second) {
+			ErrReport* report = potential.second;
+			footprintOf(report->f).reports += sizeof(ErrReport)
+				+ report->context.capacity() * sizeof(unsigned);
+		}
+	}
+	for (auto& folds : session.constantFolds) {
+		footprintOf(folds.first).constants =
+			folds.second * sizeof(llvm::ConstantInt);
+	}
+	interned = session.facts.size();
+}
+
+
+void
+MemoryProfile::recordPhase(std::string name) {
+	phases.push_back({name, getPeakRSS()});
+}
+
+
+void
+MemoryProfile::print(std::ostream& out, unsigned topN) const {
+	out << "peak rss (kb) by phase\n";
+	for (auto& phase : phases) {
+		out << "  " << phase.first << ": " << phase.second << "\n";
+	}
+
+	std::vector<FunctionFootprint> ranked;
+	for (auto& footprint : functions) {
+		ranked.push_back(footprint.second);
+	}
+	std::sort(ranked.begin(), ranked.end(),
+		[](const FunctionFootprint& f1, const FunctionFootprint& f2) {
+			return f1.total() > f2.total();
+		});
+	if (ranked.size() > topN) {
+		ranked.resize(topN);
+	}
+
+	out << "interned bounds: " << interned << "\n";
+
+	out << "approximate bytes by function (total, results, summaries, "
+		"reports, constants)\n";
+	for (auto& footprint : ranked) {
+		out << "  " << footprint.f->getName().data() << ", "
+			<< footprint.total() << ", " << footprint.results << ", "
+			<< footprint.summaries << ", " << footprint.reports << ", "
+			<< footprint.constants << "\n";
+	}
+}
+
+
 #endif
\ No newline at end of file
@@ -0,0 +1,98 @@
+//
+// Loadable pass wrapper so the analysis can run inside an existing compile
+// pipeline instead of on bitcode written out by clang and re-read by the tool.
+//
+//   opt -load lib/OverflowerPass.so -mem2reg -overflower -disable-output in.bc
+//   clang -g -Xclang -load -Xclang lib/OverflowerPass.so
+//       -mllvm -overflower-report=out.csv -c in.c
+//
+
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Scalar.h"
+
+#include <string>
+
+#include "overflower.h"
+
+
+using namespace llvm;
+using std::string;
+
+
+static cl::opt<string> reportPath{"overflower-report",
+                                  cl::desc{"Write overflower reports to "
+                                           "<file> (default: "
+                                           "<module>.overflow.csv)"},
+                                  cl::value_desc{"filename"},
+                                  cl::init("")};
+
+
+namespace {
+
+
+struct OverflowerPass : public ModulePass {
+  static char ID;
+
+  OverflowerPass() : ModulePass(ID) {}
+
+  bool
+  runOnModule(Module& m) override {
+    OverflowerSession session;
+    session.analyzeModule(m);
+
+    string fname = reportPath.empty()
+      ? m.getModuleIdentifier() + ".overflow.csv"
+      : reportPath.getValue();
+    std::ofstream fs(fname);
+    if (fs.is_open()) {
+      session.printReports(fs);
+    }
+    else {
+      errs() << "overflower: unable to write report file " << fname << "\n";
+    }
+
+    // the analysis only observes the module
+    return false;
+  }
+
+  void
+  getAnalysisUsage(AnalysisUsage& au) const override {
+    au.setPreservesAll();
+  }
+};
+
+
+} // end namespace
+
+
+char OverflowerPass::ID = 0;
+
+static RegisterPass<OverflowerPass> registerForOpt{
+  "overflower", "Detect potential buffer overflows", false, true};
+
+
+// With optimization enabled, clang has already run SROA on every function by
+// the time the module pipeline starts, so the analysis sees promoted values.
+static void
+addOverflower(const PassManagerBuilder&, legacy::PassManagerBase& pm) {
+  pm.add(new OverflowerPass());
+}
+
+// At -O0 nothing promotes allocas, so do what test/Makefile does with opt.
+// Note this means the emitted object is built from the promoted IR.
+static void
+addOverflowerO0(const PassManagerBuilder&, legacy::PassManagerBase& pm) {
+  pm.add(createPromoteMemoryToRegisterPass());
+  pm.add(new OverflowerPass());
+}
+
+static RegisterStandardPasses registerOptimized{
+  PassManagerBuilder::EP_ModuleOptimizerEarly, addOverflower};
+
+static RegisterStandardPasses registerUnoptimized{
+  PassManagerBuilder::EP_EnabledOnOptLevel0, addOverflowerO0};
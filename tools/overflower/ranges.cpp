@@ -0,0 +1,632 @@
+//
+// ConstantRange, product and LazyValueInfo backends, see ranges.h.
+//
+
+#include "ranges.h"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LazyValueInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+
+#include <map>
+#include <sstream>
+
+
+// ranges grown by this many meets are widened to the full range
+static const unsigned growthLimit = 16;
+
+
+static BOUND
+toBound(const llvm::ConstantRange& range) {
+	if (range.isFullSet() || range.getBitWidth() > 64) {
+		return BOUND({NEGINF, INF});
+	}
+	int64_t lower = range.getSignedMin().getSExtValue();
+	int64_t upper = range.getSignedMax().getSExtValue();
+	return BOUND({std::max(lower, NEGINF), std::min(upper, INF)});
+}
+
+
+static unsigned
+widthOf(llvm::Type* type) {
+	return type->isIntegerTy() ? type->getIntegerBitWidth() : 64;
+}
+
+
+static RangeValue
+predicated(const llvm::ConstantRange& other, llvm::CmpInst::Predicate pred,
+	const RangeValue* prevState) {
+	if (!llvm::CmpInst::isIntPredicate(pred)) {
+		return prevState ? *prevState : RangeValue();
+	}
+	llvm::ConstantRange allowed =
+		llvm::ConstantRange::makeAllowedICmpRegion(pred, other);
+	if (prevState && prevState->range &&
+		prevState->range->getBitWidth() == allowed.getBitWidth()) {
+		return RangeValue(prevState->range->intersectWith(allowed),
+			prevState->growth);
+	}
+	return RangeValue(allowed);
+}
+
+
+RangeValue::RangeValue(llvm::Constant* value,
+	llvm::CmpInst::Predicate pred,
+	const RangeValue* prevState) {
+	if (auto* constint = dyn_cast<ConstantInt>(value)) {
+		*this = predicated(llvm::ConstantRange(constint->getValue()), pred,
+			prevState);
+	}
+	else if (value->getType()->isIntegerTy()) {
+		// undef and constant expressions may be anything
+		*this = RangeValue(llvm::ConstantRange(widthOf(value->getType()), true));
+	}
+}
+
+
+RangeValue::RangeValue(const RangeValue& other,
+	llvm::CmpInst::Predicate pred,
+	const RangeValue* prevState) {
+	if (other.range) {
+		*this = predicated(*other.range, pred, prevState);
+	}
+	else if (prevState) {
+		*this = *prevState;
+	}
+}
+
+
+bool
+RangeValue::operator == (const RangeValue& other) const {
+	if (!range || !other.range) {
+		return !range && !other.range;
+	}
+	return range->getBitWidth() == other.range->getBitWidth() &&
+		*range == *other.range;
+}
+
+
+void
+RangeValue::makeTop() {
+	range = llvm::ConstantRange(range ? range->getBitWidth() : 64, true);
+}
+
+
+std::ostream&
+operator << (std::ostream& out, const RangeValue& v) {
+	if (!v.range) {
+		return out << "undef";
+	}
+	if (v.range->isEmptySet()) {
+		return out << "empty";
+	}
+	BOUND bound = toBound(*v.range);
+	if (bound->first <= NEGINF) {
+		out << "-inf:";
+	}
+	else {
+		out << bound->first << ":";
+	}
+	if (bound->second >= INF) {
+		out << "inf";
+	}
+	else {
+		out << bound->second;
+	}
+	return out;
+}
+
+
+RangeValue
+RangeMeet::meetPair(const RangeValue& s1, const RangeValue& s2) const {
+	RangeValue met = s1;
+	meetInto(met, s2);
+	return met;
+}
+
+
+// Set the range and growth of a defined dst, telling whether either changed.
+static bool
+replaceRange(RangeValue& dst, llvm::ConstantRange&& range, unsigned growth) {
+	bool changed = dst.growth != growth ||
+		dst.range->getBitWidth() != range.getBitWidth() ||
+		*dst.range != range;
+	*dst.range = std::move(range);
+	dst.growth = growth;
+	return changed;
+}
+
+
+bool
+RangeMeet::meetInto(RangeValue& dst, const RangeValue& src) const {
+	if (!dst.range) {
+		bool changed = src.range || dst.growth != src.growth;
+		dst = src;
+		return changed;
+	}
+	if (!src.range) {
+		return false;
+	}
+	unsigned growth = std::max(dst.growth, src.growth);
+	if (dst.range->getBitWidth() != src.range->getBitWidth()) {
+		unsigned width = std::max(dst.range->getBitWidth(), src.range->getBitWidth());
+		return replaceRange(dst, llvm::ConstantRange(width, true), growth);
+	}
+	llvm::ConstantRange met = dst.range->unionWith(*src.range);
+	if (met != *dst.range && met != *src.range) {
+		growth++;
+	}
+	if (growth > growthLimit) {
+		met = llvm::ConstantRange(met.getBitWidth(), true);
+	}
+	return replaceRange(dst, std::move(met), growth);
+}
+
+
+// The range of an integer operand at its own width, or nothing when it is
+// undefined. Ranges of summaries made Top without knowing their width are
+// fitted to the operand.
+template <typename State>
+static optional<llvm::ConstantRange>
+rangeOf(Value* v, State& state, unsigned& growth) {
+	if (auto* c = dyn_cast<Constant>(v)) {
+		RangeValue constant(c);
+		return constant.range;
+	}
+	auto found = state.find(v);
+	if (state.end() == found || !found->second.range) {
+		return optional<llvm::ConstantRange>();
+	}
+	growth = std::max(growth, found->second.growth);
+	llvm::ConstantRange range = *found->second.range;
+	unsigned width = widthOf(v->getType());
+	if (range.getBitWidth() != width) {
+		range = range.isFullSet()
+			? llvm::ConstantRange(width, true)
+			: range.sextOrTrunc(width);
+	}
+	return range;
+}
+
+
+// Like checkError: an index with an undefined range may be anything, while
+// an index never seen is assumed fine.
+template <typename State>
+static BOUND
+checkRange(Value* idx, signed limit, State& state) {
+	if (!isa<Constant>(idx) && state.end() == state.find(idx)) {
+		return BOUND();
+	}
+	unsigned growth = 0;
+	optional<llvm::ConstantRange> range = rangeOf(idx, state, growth);
+	if (!range) {
+		return BOUND({NEGINF, INF});
+	}
+	if (range->isEmptySet()) {
+		return BOUND();
+	}
+	BOUND b = toBound(*range);
+	return b->first >= 0 && b->second < limit ? BOUND() : b;
+}
+
+
+template <typename State>
+void
+RangeTransfer::operator()(llvm::Instruction& i, State& state, std::vector<unsigned>& context) {
+	if (GetElementPtrInst* gep = llvm::dyn_cast<GetElementPtrInst>(&i)) {
+		if (gep->getNumOperands() < 3) {
+			state.insert({&i, RangeValue()});
+			return;
+		}
+		unsigned limit = 0;
+		std::vector<unsigned> byteWidth = getByteWidth(gep->getSourceElementType(), limit);
+		if (BOUND b = checkRange(gep->getOperand(2), byteWidth.size(), state)) {
+			state[&i] = RangeValue();
+			optional<unsigned> lineno = getLineNumber(i);
+			if (b->first > NEGINF) {
+				b->first *= byteWidth.front();
+			}
+			if (b->second < INF) {
+				b->second *= byteWidth.back();
+			}
+			if (lineno) {
+				auto& potentials = session->potentialError[contextEncode(context)];
+				if (potentials.end() == potentials.find(gep)) {
+					potentials.insert({gep, new ErrReport{ i.getFunction(), context, lineno.value(), limit, b }});
+				}
+			}
+		}
+	}
+	else if (LoadInst* getter = llvm::dyn_cast<llvm::LoadInst>(&i)) {
+		auto& potentials = session->potentialError[contextEncode(context)];
+		auto gpair = potentials.find(getter->getPointerOperand());
+		if (potentials.end() != gpair) {
+			session->errorLog.insert(gpair->second);
+		}
+	}
+	else if (StoreInst* setter = llvm::dyn_cast<llvm::StoreInst>(&i)) {
+		auto& potentials = session->potentialError[contextEncode(context)];
+		auto spair = potentials.find(setter->getPointerOperand());
+		if (potentials.end() != spair) {
+			session->errorLog.insert(spair->second);
+		}
+	}
+	else if (auto* binOp = llvm::dyn_cast<llvm::BinaryOperator>(&i)) {
+		unsigned growth = 0;
+		auto lhs = rangeOf(binOp->getOperand(0), state, growth);
+		auto rhs = rangeOf(binOp->getOperand(1), state, growth);
+		if (lhs && rhs && binOp->getType()->isIntegerTy()) {
+			state[binOp] = RangeValue(lhs->binaryOp(binOp->getOpcode(), *rhs), growth);
+		}
+		else {
+			state[binOp] = RangeValue();
+		}
+	}
+	else if (auto* castOp = llvm::dyn_cast<llvm::CastInst>(&i)) {
+		unsigned growth = 0;
+		auto operand = rangeOf(castOp->getOperand(0), state, growth);
+		if (operand && castOp->getSrcTy()->isIntegerTy() &&
+			castOp->getDestTy()->isIntegerTy()) {
+			state[castOp] = RangeValue(operand->castOp(castOp->getOpcode(),
+				castOp->getDestTy()->getIntegerBitWidth()), growth);
+		}
+		else {
+			state[castOp] = RangeValue();
+		}
+	}
+	else {
+		state.insert({&i, RangeValue()});
+	}
+}
+
+
+template void
+RangeTransfer::operator()(llvm::Instruction& i, RangeState& state,
+	std::vector<unsigned>& context);
+
+template void
+RangeTransfer::operator()(llvm::Instruction& i, RangeComponentState& state,
+	std::vector<unsigned>& context);
+
+
+// As accelerateLoop, but at the width of each phi: start + step * k for
+// every k up to the number of backedges taken, when that cannot wrap.
+static void
+accelerateRangeLoop(Loop* loop, ScalarEvolution& se,
+	RangeAcceleration::HeaderValues& values) {
+	for (Loop* inner : *loop) {
+		accelerateRangeLoop(inner, se, values);
+	}
+
+	const SCEV* taken = se.getBackedgeTakenCount(loop);
+	if (isa<SCEVCouldNotCompute>(taken)) {
+		taken = se.getMaxBackedgeTakenCount(loop);
+	}
+	auto* takenConst = dyn_cast<SCEVConstant>(taken);
+	if (nullptr == takenConst) {
+		return; // not counted, leave it to the growth limit
+	}
+
+	for (auto& inst : *loop->getHeader()) {
+		auto* phi = dyn_cast<PHINode>(&inst);
+		if (nullptr == phi) {
+			break;
+		}
+		auto* intTy = dyn_cast<IntegerType>(phi->getType());
+		if (nullptr == intTy) {
+			continue;
+		}
+		auto* rec = dyn_cast<SCEVAddRecExpr>(se.getSCEV(phi));
+		if (nullptr == rec || !rec->isAffine() || rec->getLoop() != loop) {
+			continue;
+		}
+		auto* start = dyn_cast<SCEVConstant>(rec->getStart());
+		auto* step = dyn_cast<SCEVConstant>(rec->getStepRecurrence(se));
+		unsigned width = intTy->getBitWidth();
+		if (nullptr == start || nullptr == step ||
+			takenConst->getAPInt().getActiveBits() >= width) {
+			continue;
+		}
+
+		bool mulOverflow = false;
+		bool addOverflow = false;
+		APInt backedges = takenConst->getAPInt().zextOrTrunc(width);
+		APInt first = start->getAPInt();
+		APInt distance = step->getAPInt().smul_ov(backedges, mulOverflow);
+		APInt last = first.sadd_ov(distance, addOverflow);
+		if (mulOverflow || addOverflow) {
+			continue;
+		}
+		APInt lower = first.slt(last) ? first : last;
+		APInt upper = (first.slt(last) ? last : first) + 1;
+		if (lower == upper) {
+			continue; // every value of the type
+		}
+		values[phi] = RangeValue(llvm::ConstantRange(lower, upper));
+	}
+}
+
+
+RangeAcceleration::HeaderValues
+accelerateRangeLoops(llvm::Function& f) {
+	RangeAcceleration::HeaderValues values;
+	DominatorTree dt(f);
+	LoopInfo loops(dt);
+	if (loops.empty()) {
+		return values;
+	}
+
+	TargetLibraryInfoImpl tlii(Triple(f.getParent()->getTargetTriple()));
+	TargetLibraryInfo tli(tlii);
+	AssumptionCache ac(f);
+	ScalarEvolution se(f, tli, ac, dt, loops);
+	for (Loop* loop : loops) {
+		accelerateRangeLoop(loop, se, values);
+	}
+	return values;
+}
+
+
+RangeSession::RangeSession(const BoundOptions& options)
+	: options(options), loops(accelerateRangeLoops), liveness(checksOperand) {}
+
+
+RangeSession::~RangeSession() {
+	clear();
+}
+
+
+void
+RangeSession::clear() {
+	// every logged report is also a potential one
+	for (auto& contextErrors : potentialError) {
+		for (auto& potential : contextErrors.second) {
+			delete potential.second;
+		}
+	}
+	potentialError.clear();
+	errorLog.clear();
+	summaries.clear();
+	loops = RangeAcceleration(accelerateRangeLoops);
+	liveness.clear();
+}
+
+
+RangeResult
+RangeSession::analyzeFunction(llvm::Function& f) {
+	analysis::ForwardDataflowAnalysis<RangeValue,
+			RangeTransfer,
+			RangeMeet> analysis({}, &stats, RangeTransfer(*this));
+	analysis.setMaxContextDepth(options.contextDepth);
+	if (options.accelerateLoops) {
+		analysis.enableLoopAcceleration(&loops);
+	}
+	if (options.pruneStates) {
+		analysis.enableStatePruning(&liveness);
+	}
+	std::vector<RangeValue> Args = {RangeValue()};
+	return analysis.computeForwardDataflow(summaries, f, Args);
+}
+
+
+void
+RangeSession::analyzeModule(llvm::Module& m) {
+	llvm::DenseSet<llvm::Function*> relevant;
+	if (options.pruneIrrelevant) {
+		relevant = relevantFunctions(m);
+	}
+	for (auto& f : m) {
+		if (f.isDeclaration()) {
+			continue;
+		}
+		if (options.pruneIrrelevant && 0 == relevant.count(&f)) {
+			continue;
+		}
+		analyzeFunction(f);
+	}
+}
+
+
+std::vector<ErrReport>
+RangeSession::getReports() const {
+	std::vector<ErrReport> reports;
+	for (ErrReport* report : errorLog) {
+		reports.push_back(*report);
+	}
+	return reports;
+}
+
+
+// Closed forms only replace the meets of a header phi as a whole, so a
+// product takes those both domains know.
+static BoundRangeAcceleration::HeaderValues
+accelerateProductLoops(llvm::Function& f) {
+	BoundRangeAcceleration::HeaderValues values;
+	BoundAcceleration::HeaderValues bounds = accelerateLoops(f);
+	RangeAcceleration::HeaderValues ranges = accelerateRangeLoops(f);
+	for (auto& bound : bounds) {
+		auto range = ranges.find(bound.first);
+		if (ranges.end() != range) {
+			values[bound.first] =
+				BoundRangeValue(std::make_tuple(bound.second, range->second));
+		}
+	}
+	return values;
+}
+
+
+ProductSession::ProductSession(const BoundOptions& options)
+	: options(options), bounds(options), ranges(options),
+	loops(accelerateProductLoops), liveness(checksOperand) {}
+
+
+BoundRangeResult
+ProductSession::analyzeFunction(llvm::Function& f) {
+	BoundRangeProduct::Transfer transfer{BoundTransfer(bounds),
+		RangeTransfer(ranges)};
+	analysis::ForwardDataflowAnalysis<BoundRangeValue,
+			BoundRangeProduct::Transfer,
+			BoundRangeProduct::Meet> analysis({}, &stats, transfer);
+	analysis.setMaxContextDepth(options.contextDepth);
+	if (options.accelerateLoops) {
+		analysis.enableLoopAcceleration(&loops);
+	}
+	if (options.pruneStates) {
+		analysis.enableStatePruning(&liveness);
+	}
+	std::vector<BoundRangeValue> Args = {BoundRangeValue()};
+	return analysis.computeForwardDataflow(summaries, f, Args);
+}
+
+
+void
+ProductSession::analyzeModule(llvm::Module& m) {
+	BoundFacts::Scope scope(&bounds.getFacts());
+	llvm::DenseSet<llvm::Function*> relevant;
+	if (options.pruneIrrelevant) {
+		relevant = relevantFunctions(m);
+	}
+	for (auto& f : m) {
+		if (f.isDeclaration()) {
+			continue;
+		}
+		if (options.pruneIrrelevant && 0 == relevant.count(&f)) {
+			continue;
+		}
+		analyzeFunction(f);
+	}
+}
+
+
+std::vector<ErrReport>
+ProductSession::getReports() const {
+	// the bounds of what the range domain reports, by the access
+	std::map<std::tuple<llvm::Function*, std::vector<unsigned>, size_t>,
+		BOUND> confirmed;
+	for (auto& report : ranges.getReports()) {
+		confirmed[std::make_tuple(report.f, report.context, report.lineno)] =
+			report.access;
+	}
+	std::vector<ErrReport> reports;
+	for (auto& report : bounds.getReports()) {
+		auto range = confirmed.find(
+			std::make_tuple(report.f, report.context, report.lineno));
+		if (confirmed.end() == range) {
+			continue;
+		}
+		ErrReport both = report;
+		int64_t lower = std::max(report.access->first, range->second->first);
+		int64_t upper = std::min(report.access->second, range->second->second);
+		if (lower <= upper) {
+			both.access = BOUND({lower, upper});
+		}
+		reports.push_back(both);
+	}
+	return reports;
+}
+
+
+namespace {
+
+
+struct LazyValueChecks : public FunctionPass {
+	static char ID;
+
+	std::vector<ErrReport>& reports;
+	analysis::FixpointStats& stats;
+
+	LazyValueChecks(std::vector<ErrReport>& reports,
+		analysis::FixpointStats& stats)
+		: FunctionPass(ID), reports(reports), stats(stats) {}
+
+	bool
+	runOnFunction(Function& f) override {
+		stats.analyses++;
+		LazyValueInfo& lvi = getAnalysis<LazyValueInfoWrapperPass>().getLVI();
+
+		llvm::DenseMap<llvm::Value*, ErrReport> potentials;
+		llvm::DenseSet<llvm::Value*> confirmed;
+		for (auto& i : llvm::instructions(f)) {
+			stats.transfers++;
+			if (auto* gep = dyn_cast<GetElementPtrInst>(&i)) {
+				optional<unsigned> lineno = getLineNumber(i);
+				if (gep->getNumOperands() < 3 || !lineno) {
+					continue;
+				}
+				unsigned limit = 0;
+				std::vector<unsigned> byteWidth = getByteWidth(gep->getSourceElementType(), limit);
+				Value* idx = gep->getOperand(2);
+				if (!idx->getType()->isIntegerTy()) {
+					continue;
+				}
+				llvm::ConstantRange range = isa<Constant>(idx)
+					? *RangeValue(cast<Constant>(idx)).range
+					: lvi.getConstantRange(idx, gep->getParent(), gep);
+				if (range.isEmptySet()) {
+					continue;
+				}
+				BOUND b = toBound(range);
+				signed elements = byteWidth.size();
+				if (b->first >= 0 && b->second < elements) {
+					continue;
+				}
+				if (b->first > NEGINF) {
+					b->first *= byteWidth.front();
+				}
+				if (b->second < INF) {
+					b->second *= byteWidth.back();
+				}
+				potentials.insert({gep, ErrReport{&f, {}, lineno.value(), limit, b}});
+			}
+			else if (isa<LoadInst>(&i) || isa<StoreInst>(&i)) {
+				Value* ptr = isa<LoadInst>(&i)
+					? cast<LoadInst>(&i)->getPointerOperand()
+					: cast<StoreInst>(&i)->getPointerOperand();
+				auto potential = potentials.find(ptr);
+				if (potentials.end() != potential && confirmed.insert(ptr).second) {
+					reports.push_back(potential->second);
+				}
+			}
+		}
+		return false;
+	}
+
+	void
+	getAnalysisUsage(AnalysisUsage& au) const override {
+		au.addRequired<LazyValueInfoWrapperPass>();
+		au.setPreservesAll();
+	}
+};
+
+
+} // end namespace
+
+
+char LazyValueChecks::ID = 0;
+
+
+std::vector<ErrReport>
+lazyValueReports(llvm::Module& m, analysis::FixpointStats& stats) {
+	initializeLazyValueInfoWrapperPassPass(*PassRegistry::getPassRegistry());
+
+	std::vector<ErrReport> reports;
+	legacy::FunctionPassManager passes(&m);
+	passes.add(new LazyValueChecks(reports, stats));
+	passes.doInitialization();
+	for (auto& f : m) {
+		if (!f.isDeclaration()) {
+			passes.run(f);
+		}
+	}
+	passes.doFinalization();
+	return reports;
+}
@@ -0,0 +1,135 @@
+//
+// Tab separated text records, see records.h.
+//
+
+#include "records.h"
+
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+
+
+std::string
+typeName(llvm::Type* type) {
+	std::string name;
+	llvm::raw_string_ostream out(name);
+	type->print(out);
+	return out.str();
+}
+
+
+static void
+collectType(llvm::Type* type, llvm::DenseSet<llvm::Type*>& seen,
+	std::unordered_map<std::string, llvm::Type*>& types) {
+	if (!seen.insert(type).second) {
+		return;
+	}
+	types.insert({typeName(type), type});
+	for (auto sub = type->subtype_begin(); sub != type->subtype_end(); ++sub) {
+		collectType(*sub, seen, types);
+	}
+}
+
+
+std::unordered_map<std::string, llvm::Type*>
+moduleTypes(llvm::Module& m) {
+	llvm::DenseSet<llvm::Type*> seen;
+	std::unordered_map<std::string, llvm::Type*> types;
+	for (auto& global : m.globals()) {
+		collectType(global.getType(), seen, types);
+	}
+	for (auto& f : m) {
+		collectType(f.getType(), seen, types);
+		for (auto& i : llvm::instructions(f)) {
+			collectType(i.getType(), seen, types);
+			for (auto& op : i.operands()) {
+				collectType(op->getType(), seen, types);
+			}
+		}
+	}
+	return types;
+}
+
+
+std::vector<std::string>
+splitFields(const std::string& line) {
+	std::vector<std::string> fields;
+	std::istringstream in(line);
+	std::string field;
+	while (std::getline(in, field, '\t')) {
+		fields.push_back(field);
+	}
+	if (!line.empty() && '\t' == line.back()) {
+		fields.push_back("");
+	}
+	return fields;
+}
+
+
+bool
+parseInt(const std::string& field, int64_t& value) {
+	if (field.empty()) {
+		return false;
+	}
+	char* end = nullptr;
+	errno = 0;
+	value = strtoll(field.c_str(), &end, 10);
+	return 0 == errno && '\0' == *end;
+}
+
+
+void
+appendRange(std::string& record, const BOUND& range) {
+	if (range) {
+		record += "\t" + std::to_string(range->first) + ":"
+			+ std::to_string(range->second);
+	}
+	else {
+		record += "\tundef";
+	}
+}
+
+
+bool
+parseRange(const std::string& field, BOUND& range) {
+	if ("undef" == field) {
+		range = BOUND();
+		return true;
+	}
+	size_t colon = field.find(':', 1);
+	int64_t lower = 0;
+	int64_t upper = 0;
+	if (std::string::npos == colon || !parseInt(field.substr(0, colon), lower)
+			|| !parseInt(field.substr(colon + 1), upper)) {
+		return false;
+	}
+	range = BOUND({lower, upper});
+	return true;
+}
+
+
+void
+appendContext(std::string& record, const std::vector<unsigned>& context) {
+	record += "\t";
+	for (size_t i = 0; i < context.size(); i++) {
+		record += (i ? ":" : "") + std::to_string(context[i]);
+	}
+}
+
+
+bool
+parseContext(const std::string& field, std::vector<unsigned>& context) {
+	std::istringstream in(field);
+	std::string callsite;
+	while (std::getline(in, callsite, ':')) {
+		int64_t value = 0;
+		if (!parseInt(callsite, value)) {
+			return false;
+		}
+		context.push_back(value);
+	}
+	return true;
+}
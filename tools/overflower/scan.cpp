@@ -0,0 +1,235 @@
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "canonicalize.h"
+#include "compiledb.h"
+#include "overflower.h"
+
+
+using namespace llvm;
+using std::string;
+using std::unique_ptr;
+
+
+static cl::OptionCategory scanCategory{"overflower-scan options"};
+
+static cl::opt<string> databasePath{cl::Positional,
+                                    cl::desc{"<Compilation database>"},
+                                    cl::value_desc{"compile_commands.json"},
+                                    cl::init(""),
+                                    cl::Required,
+                                    cl::cat{scanCategory}};
+
+static cl::opt<string> outPath{cl::Positional,
+                               cl::desc{"<Report output>"},
+                               cl::value_desc{"csv filename"},
+                               cl::init(""),
+                               cl::cat{scanCategory}};
+
+static cl::opt<string> cacheDir{"cache-dir",
+                                cl::desc{"Directory of the cached bitcode"},
+                                cl::value_desc{"directory"},
+                                cl::init(".overflower-cache"),
+                                cl::cat{scanCategory}};
+
+static cl::opt<string> clangPath{"clang",
+                                 cl::desc{"Compiler to build bitcode with "
+                                          "(default: clang on the PATH)"},
+                                 cl::value_desc{"filename"},
+                                 cl::init(""),
+                                 cl::cat{scanCategory}};
+
+static cl::list<string> canonicalizePasses{"canonicalize",
+                                           cl::desc{"Passes to run on the "
+                                                    "bitcode before caching "
+                                                    "it (default: mem2reg, "
+                                                    "empty for none)"},
+                                           cl::value_desc{"pass,..."},
+                                           cl::CommaSeparated,
+                                           cl::cat{scanCategory}};
+
+static cl::opt<unsigned> jobs{"j",
+                              cl::desc{"Translation units compiled and "
+                                       "analyzed at once (default: all "
+                                       "cores)"},
+                              cl::value_desc{"N"},
+                              cl::init(0),
+                              cl::cat{scanCategory}};
+
+static cl::opt<int> contextDepth{"context-depth",
+                                 cl::desc{"Follow calls in contexts of at "
+                                          "most <n> call sites, -1 for none"},
+                                 cl::value_desc{"n"},
+                                 cl::init(2),
+                                 cl::cat{scanCategory}};
+
+static cl::opt<bool> adaptiveContexts{"adaptive-contexts",
+                                      cl::desc{"Analyze without contexts "
+                                               "first, then follow calls only "
+                                               "on chains leading to "
+                                               "potential errors"},
+                                      cl::init(false),
+                                      cl::cat{scanCategory}};
+
+static cl::opt<bool> scanStats{"scan-stats",
+                               cl::desc{"Print how many units were cached, "
+                                        "compiled or failed, and where the "
+                                        "time went, to stderr"},
+                               cl::init(false),
+                               cl::cat{scanCategory}};
+
+
+namespace {
+
+
+// the outcome of one translation unit, kept until all are done so that the
+// reports are written in the order of the database
+struct UnitResult {
+  bool cached = false;
+  bool failed = false;
+  string reports;
+  double loadMs = 0;
+  double analysisMs = 0;
+};
+
+
+}
+
+
+static void
+scanUnit(const CompileCommand& command, BitcodeCache& cache,
+         const BoundOptions& options, UnitResult& result,
+         std::mutex& diagnostics) {
+  auto start = std::chrono::steady_clock::now();
+  LLVMContext context;
+  string error;
+  unique_ptr<Module> module = cache.load(command, context, result.cached,
+                                         error);
+  auto loaded = std::chrono::steady_clock::now();
+  result.loadMs =
+    std::chrono::duration<double, std::milli>(loaded - start).count();
+  if (!module) {
+    std::lock_guard<std::mutex> guard(diagnostics);
+    errs() << "Error compiling " << command.file << ": " << error << "\n";
+    result.failed = true;
+    return;
+  }
+
+  // Reports do not name the file of the function, so every line is
+  // prefixed with the translation unit it came from.
+  OverflowerSession session(options);
+  session.analyzeModule(*module);
+  std::ostringstream out;
+  for (const ErrReport& report : session.getReports()) {
+    out << command.file << ", ";
+    printReport(out, report);
+  }
+  result.reports = out.str();
+  session.clear();
+  result.analysisMs = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - loaded).count();
+}
+
+
+int
+main(int argc, char** argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  llvm::PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj shutdown;
+  cl::HideUnrelatedOptions(scanCategory);
+  cl::ParseCommandLineOptions(argc, argv);
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<CompileCommand> commands;
+  string error;
+  if (!readCompilationDatabase(databasePath.getValue(), commands, error)) {
+    errs() << "Error reading compilation database: " << databasePath << " "
+           << error << "\n";
+    return -1;
+  }
+
+  string clang = clangPath.getValue();
+  if (clang.empty()) {
+    auto found = sys::findProgramByName("clang");
+    if (!found) {
+      errs() << "Cannot find clang on the PATH, pass -clang\n";
+      return -1;
+    }
+    clang = *found;
+  }
+
+  std::vector<string> passes(canonicalizePasses.begin(),
+                             canonicalizePasses.end());
+  if (canonicalizePasses.getNumOccurrences() == 0) {
+    passes = {"mem2reg"};
+  }
+  BitcodeCache cache(cacheDir.getValue(), clang, passes);
+  if (!cache.open(error)) {
+    errs() << "Error opening cache directory: " << cacheDir << " " << error
+           << "\n";
+    return -1;
+  }
+
+  BoundOptions options;
+  options.contextDepth     = contextDepth;
+  options.adaptiveContexts = adaptiveContexts;
+
+  // Each unit is compiled, or loaded from the cache, and analyzed on one
+  // thread, in a context of its own.
+  std::vector<UnitResult> results(commands.size());
+  std::mutex diagnostics;
+  {
+    llvm::ThreadPool pool(jobs
+      ? jobs.getValue()
+      : std::max(1u, std::thread::hardware_concurrency()));
+    for (size_t k = 0; k < commands.size(); k++) {
+      pool.async([&, k] () {
+        scanUnit(commands[k], cache, options, results[k], diagnostics);
+      });
+    }
+    pool.wait();
+  }
+
+  std::ofstream fs(outPath.getValue());
+  std::ostream& out = fs.is_open() ? fs : std::cout;
+  unsigned cached = 0, failed = 0;
+  double loadMs = 0, analysisMs = 0;
+  for (auto& result : results) {
+    out << result.reports;
+    cached += result.cached;
+    failed += result.failed;
+    loadMs += result.loadMs;
+    analysisMs += result.analysisMs;
+  }
+  fs.close();
+
+  if (scanStats) {
+    std::chrono::duration<double, std::milli> wall =
+      std::chrono::steady_clock::now() - start;
+    errs() << "scan: " << results.size() << " units, " << cached
+           << " cached, " << results.size() - cached - failed
+           << " compiled, " << failed << " failed, "
+           << uint64_t(wall.count()) << " ms wall, " << uint64_t(loadMs)
+           << " ms loading, " << uint64_t(analysisMs) << " ms analyzing\n";
+  }
+
+  return failed ? -1 : 0;
+}
@@ -0,0 +1,331 @@
+//
+// Sharded analysis in forked workers, see shards.h.
+//
+
+#include "shards.h"
+#include "checkpoint.h"
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <csignal>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+struct SharedSummaryTable::Header {
+	std::atomic<unsigned long> published;
+	std::atomic<unsigned long> hits;
+	std::atomic<unsigned long> dropped;
+};
+
+
+enum SlotState : uint32_t {
+	Empty = 0,
+	Claimed = 1,
+	Published = 2,
+};
+
+
+struct SharedSummaryTable::Slot {
+	std::atomic<uint32_t> state;
+	uint32_t pass;
+	llvm::Function* function;
+	uint64_t digest[2];
+	// the summary
+	int64_t lower;
+	int64_t upper;
+	llvm::Type* type;
+	float entropy;
+	uint8_t defined;
+};
+
+
+// Fresh pages are zero filled, which is an empty slot and a zero counter,
+// so the table is used without touching every page up front.
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+	"slot states must be plain words in shared memory");
+
+
+// slots probed from a key's home slot before its summary is left out
+static const size_t probeLimit = 32;
+
+
+static void
+digestOf(unsigned pass, llvm::Function* f, const std::vector<BoundValue>& args,
+	uint64_t digest[2]) {
+	llvm::hash_code first = llvm::hash_combine(pass, f, args.size());
+	llvm::hash_code second = llvm::hash_combine(args.size(), f, pass, 0x9e3779b97f4a7c15ull);
+	for (auto& arg : args) {
+		const BOUND& range = arg.range();
+		bool defined = bool(range);
+		int64_t lower = defined ? range->first : 0;
+		int64_t upper = defined ? range->second : 0;
+		uint32_t entropy = llvm::FloatToBits(arg.entropy());
+		llvm::Type* type = arg.type();
+		first = llvm::hash_combine(first, defined, lower, upper, entropy, type);
+		second = llvm::hash_combine(type, upper, second, entropy, lower, defined);
+	}
+	digest[0] = size_t(first);
+	digest[1] = size_t(second);
+}
+
+
+SharedSummaryTable::SharedSummaryTable(size_t bytes) {
+	size_t count = bytes > sizeof(Header) ? (bytes - sizeof(Header)) / sizeof(Slot) : 0;
+	if (0 == count) {
+		return;
+	}
+	this->bytes = sizeof(Header) + count * sizeof(Slot);
+	mapping = mmap(nullptr, this->bytes, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == mapping) {
+		mapping = nullptr;
+		return;
+	}
+	header = static_cast<Header*>(mapping);
+	slots = reinterpret_cast<Slot*>(static_cast<char*>(mapping) + sizeof(Header));
+	capacity = count;
+}
+
+
+SharedSummaryTable::~SharedSummaryTable() {
+	if (mapping) {
+		munmap(mapping, bytes);
+	}
+}
+
+
+void
+SharedSummaryTable::attach(BoundSummary& summaries,
+	analysis::SummaryStore<BoundValue>* next) {
+	this->summaries = &summaries;
+	this->next = next;
+}
+
+
+SharedSummaryTable::Slot*
+SharedSummaryTable::find(llvm::Function* f, const std::vector<BoundValue>& args) {
+	uint64_t digest[2];
+	digestOf(pass, f, args, digest);
+	for (size_t probe = 0; probe < probeLimit && probe < capacity; probe++) {
+		Slot& slot = slots[(digest[0] + probe) % capacity];
+		uint32_t state = slot.state.load(std::memory_order_acquire);
+		if (Empty == state) {
+			return nullptr;
+		}
+		if (Published == state && slot.function == f && slot.pass == pass
+				&& slot.digest[0] == digest[0] && slot.digest[1] == digest[1]) {
+			return &slot;
+		}
+	}
+	return nullptr;
+}
+
+
+void
+SharedSummaryTable::publish(llvm::Function* f,
+	const std::vector<BoundValue>& args, const BoundValue& summary) {
+	uint64_t digest[2];
+	digestOf(pass, f, args, digest);
+	for (size_t probe = 0; probe < probeLimit && probe < capacity; probe++) {
+		Slot& slot = slots[(digest[0] + probe) % capacity];
+		uint32_t state = slot.state.load(std::memory_order_acquire);
+		if (Empty == state && slot.state.compare_exchange_strong(state, Claimed,
+				std::memory_order_acq_rel)) {
+			BoundFact fact = summary.fact();
+			slot.pass = pass;
+			slot.function = f;
+			slot.digest[0] = digest[0];
+			slot.digest[1] = digest[1];
+			slot.defined = bool(fact.range);
+			slot.lower = fact.range ? fact.range->first : 0;
+			slot.upper = fact.range ? fact.range->second : 0;
+			slot.type = fact.boundType;
+			slot.entropy = fact.range_entropy;
+			slot.state.store(Published, std::memory_order_release);
+			header->published++;
+			return;
+		}
+		// a failed swap left the state the slot has now
+		if (Published == state && slot.function == f && slot.pass == pass
+				&& slot.digest[0] == digest[0] && slot.digest[1] == digest[1]) {
+			return;
+		}
+	}
+	header->dropped++;
+}
+
+
+bool
+SharedSummaryTable::lookup(llvm::Function* f,
+	const std::vector<BoundValue>& args, bool count) {
+	if (next) {
+		if (next->lookup(f, args, count)) {
+			return true;
+		}
+	}
+	else {
+		auto known = summaries->find(f);
+		if (summaries->end() != known && known->second.end() != known->second.find(args)) {
+			return true;
+		}
+	}
+
+	Slot* slot = find(f, args);
+	if (nullptr == slot) {
+		return false;
+	}
+	BoundFact fact;
+	if (slot->defined) {
+		fact.range = BOUND({slot->lower, slot->upper});
+	}
+	fact.range_entropy = slot->entropy;
+	fact.boundType = slot->type;
+	(*summaries)[f][args] = BoundValue(fact);
+	if (next) {
+		// copied rather than computed, so it is the first to go
+		next->admit(f, args, 0);
+	}
+	if (count) {
+		header->hits++;
+	}
+	return true;
+}
+
+
+void
+SharedSummaryTable::admit(llvm::Function* f,
+	const std::vector<BoundValue>& args, unsigned long cost) {
+	// published before the bounded store may drop it
+	auto known = summaries->find(f);
+	if (summaries->end() != known) {
+		auto summary = known->second.find(args);
+		if (known->second.end() != summary) {
+			publish(f, args, summary->second);
+		}
+	}
+	if (next) {
+		next->admit(f, args, cost);
+	}
+}
+
+
+void
+SharedSummaryTable::invalidate() {
+	pass++;
+	if (next) {
+		next->invalidate();
+	}
+}
+
+
+SharedSummaryCounters
+SharedSummaryTable::getCounters() const {
+	SharedSummaryCounters counters;
+	if (header) {
+		counters.published = header->published;
+		counters.hits = header->hits;
+		counters.dropped = header->dropped;
+	}
+	return counters;
+}
+
+
+static int
+runWorker(llvm::Module& m, BoundOptions options, unsigned shard,
+	unsigned workers, unsigned interval, SharedSummaryTable& table,
+	const std::string& path) {
+	options.shard = shard;
+	options.shards = workers;
+	OverflowerSession session(options);
+	table.attach(session.getSummaries(), session.getSummaryStore());
+	session.shareSummaries(&table);
+	SessionCheckpoint checkpoint(interval);
+	if (!checkpoint.create(path, m)) {
+		return 1;
+	}
+	session.enableCheckpoint(&checkpoint);
+	session.analyzeModule(m);
+	return 0;
+}
+
+
+bool
+analyzeSharded(llvm::Module& m, const BoundOptions& options,
+	const ShardOptions& shards, OverflowerSession& session,
+	ShardResults& results, std::string& error) {
+	SharedSummaryTable table(size_t(shards.tableMb) << 20);
+	if (!table.isMapped()) {
+		error = "cannot map the shared summary table";
+		return false;
+	}
+
+	std::vector<std::string> paths;
+	for (unsigned k = 0; k < shards.workers; k++) {
+		llvm::SmallString<128> path;
+		if (llvm::sys::fs::createTemporaryFile("overflower-shard", "ckpt", path)) {
+			error = "cannot create a checkpoint file for the workers";
+			for (auto& created : paths) {
+				llvm::sys::fs::remove(created);
+			}
+			return false;
+		}
+		paths.push_back(path.str().str());
+	}
+
+	// anything still buffered would be written again by every worker
+	std::cout.flush();
+	std::cerr.flush();
+	llvm::outs().flush();
+	llvm::errs().flush();
+
+	std::vector<pid_t> pids;
+	for (unsigned k = 0; k < shards.workers; k++) {
+		pid_t pid = fork();
+		if (0 == pid) {
+			// skip the destructors and exit handlers of the parent's state
+			_exit(runWorker(m, options, k, shards.workers,
+				shards.checkpointInterval, table, paths[k]));
+		}
+		if (pid < 0) {
+			error = "cannot fork worker " + std::to_string(k);
+			for (pid_t started : pids) {
+				kill(started, SIGKILL);
+				waitpid(started, nullptr, 0);
+			}
+			for (auto& created : paths) {
+				llvm::sys::fs::remove(created);
+			}
+			return false;
+		}
+		pids.push_back(pid);
+	}
+
+	// the checkpoints of failed workers still hold what they completed
+	for (unsigned k = 0; k < shards.workers; k++) {
+		int status = 0;
+		bool finished = pids[k] == waitpid(pids[k], &status, 0)
+			&& WIFEXITED(status) && 0 == WEXITSTATUS(status);
+		OverflowerSession part;
+		SessionCheckpoint reader;
+		std::string readError;
+		if (reader.read(paths[k], m, part, readError)) {
+			session.merge(part);
+		}
+		else {
+			finished = false;
+		}
+		if (!finished) {
+			results.failed.push_back(k);
+		}
+		llvm::sys::fs::remove(paths[k]);
+	}
+	results.summaries = table.getCounters();
+	return true;
+}
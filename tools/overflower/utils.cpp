@@ -4,6 +4,9 @@
 
 #include "utils.h"
 
+#include <algorithm>
+#include <sys/resource.h>
+
 #ifdef OVERFLOWER_UTILS_H
 
 
@@ -77,4 +80,23 @@ getByteWidth(llvm::Type* ty, unsigned& total) {
 }
 
 
+size_t
+getPeakRSS() {
+	struct rusage usage;
+	struct rusage children;
+	if (0 != getrusage(RUSAGE_SELF, &usage)) {
+		return 0;
+	}
+	if (0 == getrusage(RUSAGE_CHILDREN, &children)) {
+		usage.ru_maxrss = std::max(usage.ru_maxrss, children.ru_maxrss);
+	}
+#ifdef __APPLE__
+	// darwin reports bytes rather than kilobytes
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+}
+
+
 #endif
\ No newline at end of file